@@ -108,9 +108,9 @@ int main(void) {
 
   /* initialize and run */
   #ifdef _16SEG
-  segdisp_init(&disp, &segments, &digits, SEGDISP_INVERTED_SEGMENT | SEGDISP_NONINVERTED_DRIVER | SEGDISP_SEGMENTS_SIXTEEN);
+  segdisp_init(&disp, &segments, &digits, SEGDISP_INVERTED_SEGMENT | SEGDISP_INVERTED_DRIVER | SEGDISP_SEGMENTS_SIXTEEN);
   #else
-  segdisp_init(&disp, &segments, &digits, SEGDISP_INVERTED_SEGMENT | SEGDISP_NONINVERTED_DRIVER | SEGDISP_SEGMENTS_SEVEN);
+  segdisp_init(&disp, &segments, &digits, SEGDISP_INVERTED_SEGMENT | SEGDISP_INVERTED_DRIVER | SEGDISP_SEGMENTS_SEVEN);
   #endif
 
   char input[50];
@@ -0,0 +1,1688 @@
+/* bench.c -- Segdisp benchmarks on the host stand-in
+ *
+ * Copyright (C) 2016 Ondrej Novak
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+/**
+ * @file
+ * @brief Benchmarks of the refresh, scroll and mapping paths
+ */
+
+#include "ch.h"
+#include "hal.h"
+#include "host.h"
+#include "sim.h"
+#include "segdisp.h"
+#include "segdisp_mgr.h"
+#include "segdisp_595.h"
+#include "segdisp_fixed.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STEP_ITERATIONS 2000000
+#define SCROLL_ITERATIONS 20000
+#define MAPPER_ITERATIONS 20000
+#define ENCODE_ITERATIONS 2000
+#define MBOX_FRAMES 1000
+#define LIFECYCLES 50
+#define TIMER_STEPS 200000
+#define PHASES_RECORDED 64
+#define UPDATE_ITERATIONS 200000
+
+/* keeps results of the measured code alive */
+static volatile uint32_t sink;
+
+/* 16 segment wiring of the example application */
+static const segdisp_pin_def_t seg16_pins[17] = {
+	{GPIOE, 10}, {GPIOE, 7}, {GPIOE, 6}, {GPIOE, 2}, {GPIOC, 15}, {GPIOE, 0},
+	{GPIOC, 14}, {GPIOE, 13}, {GPIOE, 11}, {GPIOE, 4}, {GPIOE, 15}, {GPIOE, 9},
+	{GPIOE, 8}, {GPIOE, 3}, {GPIOE, 12}, {GPIOE, 14}, {GPIOC, 13}
+};
+
+/**
+ * Benchmarked display configuration
+ */
+typedef struct bench_conf {
+	const char *name;
+	int sixteen;
+	int digits;
+} bench_conf_t;
+
+static const bench_conf_t confs[] = {
+	{"7seg x4", 0, 4},
+	{"7seg x8", 0, 8},
+	{"7seg x16", 0, 16},
+	{"16seg x1", 1, 1},
+	{"16seg x4", 1, 4},
+	{"16seg x8", 1, 8},
+};
+
+static segdisp_pins_t *pins_alloc(int number){
+	segdisp_pins_t *pins = calloc(1, sizeof(segdisp_pins_t) + number * sizeof(segdisp_pin_def_t));
+
+	pins->number = number;
+	return pins;
+}
+
+/* Builds display of the given configuration, segments of 7 segment displays start at seg_pin of seg_port, digits at dig_pin of dig_port */
+static segdisp_t *bench_display_at(const bench_conf_t *conf, ioportid_t seg_port, int seg_pin, ioportid_t dig_port, int dig_pin){
+	static segdisp_scroll_conf_t scroll = {1000, 1};
+	segdisp_t *disp = calloc(1, sizeof(segdisp_t));
+	segdisp_pins_t *segments;
+	segdisp_pins_t *digits = pins_alloc(conf->digits);
+	int i;
+
+	if(conf->sixteen){
+		segments = pins_alloc(17);
+		memcpy(segments->pins, seg16_pins, sizeof(seg16_pins));
+	}
+	else{
+		segments = pins_alloc(8);
+		for(i = 0; i < 8; i++){
+			segments->pins[i].port = seg_port;
+			segments->pins[i].pin = seg_pin + i;
+		}
+	}
+
+	for(i = 0; i < conf->digits; i++){
+		digits->pins[i].port = dig_port;
+		digits->pins[i].pin = dig_pin + i;
+	}
+
+	disp->scroll = &scroll;
+	if(segdisp_init(disp, segments, digits, conf->sixteen ? SEGDISP_SEGMENTS_SIXTEEN : SEGDISP_SEGMENTS_SEVEN) != 0){
+		fprintf(stderr, "segdisp_init failed for %s\n", conf->name);
+		exit(1);
+	}
+	return disp;
+}
+
+/* Builds display of the given configuration, segments of 7 segment displays are on GPIOA, digits on GPIOD */
+static segdisp_t *bench_display(const bench_conf_t *conf){
+	return bench_display_at(conf, GPIOA, 0, GPIOD, 0);
+}
+
+static void bench_refresh(const bench_conf_t *conf){
+	segdisp_t *disp = bench_display(conf);
+	static char text[] = "8.8.8.8.8.8.8.8.8.8.8.8.8.8.8.8.";
+	uint64_t start;
+	unsigned long writes;
+	unsigned long toggles;
+	int i;
+
+	segdisp_set_str(disp, text);
+
+	host_pal_reset();
+	for(i = 0; i < disp->digits->number; i++){
+		segdisp_show_digit(disp, i, disp->actual[i]);
+	}
+	writes = host_pal_writes;
+	toggles = host_pal_toggles;
+
+	start = host_clock_ns();
+	for(i = 0; i < STEP_ITERATIONS; i++){
+		int position = i % disp->digits->number;
+		segdisp_show_digit(disp, position, disp->actual[position]);
+	}
+
+	printf("%-10s %12lu %12lu %12.1f\n", conf->name, writes, toggles,
+		(double) (host_clock_ns() - start) / STEP_ITERATIONS);
+}
+
+static void bench_scroll(int length, int step){
+	static const bench_conf_t conf = {"7seg x8", 0, 8};
+	segdisp_t *disp = bench_display(&conf);
+	char *text = malloc(length + 1);
+	uint32_t *codes = malloc(SEGDISP_MSG_WORDS(length, conf.digits) * sizeof(uint32_t));
+	uint64_t start;
+	double encode;
+	int i;
+
+	for(i = 0; i < length; i++){
+		text[i] = "0123456789ABCDEF -"[i % 18];
+	}
+	text[length] = '\0';
+	segdisp_set_msg_buffer(disp, codes, SEGDISP_MSG_WORDS(length, conf.digits));
+
+	start = host_clock_ns();
+	for(i = 0; i < ENCODE_ITERATIONS; i++){
+		segdisp_set_str(disp, text);
+	}
+	encode = (double) (host_clock_ns() - start) / ENCODE_ITERATIONS;
+
+	start = host_clock_ns();
+	for(i = 0; i < SCROLL_ITERATIONS; i++){
+		segdisp_move_cont(disp, step);
+	}
+
+	printf("%8d %6d %14.1f %14.1f\n", length, step, (double) (host_clock_ns() - start) / SCROLL_ITERATIONS, encode);
+	segdisp_set_msg_buffer(disp, NULL, 0);
+	free(codes);
+	free(text);
+}
+
+static systime_t phase_times[PHASES_RECORDED];
+static uint32_t phase_digits[PHASES_RECORDED];
+static int phases;
+
+/* records the phases of the refresh */
+static void phase_record(void *ctx, segdisp_t *disp, uint32_t digit_mask, uint32_t segments){
+	(void) ctx;
+	segdisp_gpio_backend.phase(segdisp_gpio_backend.ctx, disp, digit_mask, segments);
+	if(phases < PHASES_RECORDED){
+		phase_times[phases] = chVTGetSystemTimeX();
+		phase_digits[phases] = digit_mask;
+		phases++;
+	}
+}
+
+/* GPIO backend recording the phases, the ports are written only when they change */
+static const segdisp_backend_t phase_backend = {phase_record, NULL, NULL, NULL};
+
+/* Runs the timer driven refresh, checks that the digit phases are evenly spaced and in order */
+static int bench_timer(const bench_conf_t *conf){
+	segdisp_t *disp = bench_display(conf);
+	systime_t min = (systime_t) -1;
+	systime_t max = 0;
+	systime_t period;
+	uint64_t start;
+	int ordered = 1;
+	int i;
+
+	segdisp_set_str(disp, "0123456789ABCDEF");
+	disp->refresh = 1000;
+	period = US2ST(disp->refresh);
+
+	segdisp_set_backend(disp, &phase_backend);
+	phases = 0;
+	segdisp_run_timer(disp);
+	host_time_advance(period * (PHASES_RECORDED + 1));
+
+	for(i = 1; i < phases; i++){
+		systime_t d = phase_times[i] - phase_times[i - 1];
+		if(d < min)
+			min = d;
+		if(d > max)
+			max = d;
+		if(phase_digits[i] != 1UL << (i % conf->digits)){
+			ordered = 0;
+		}
+	}
+
+	start = host_clock_ns();
+	host_time_advance(period * TIMER_STEPS);
+
+	printf("%-10s %8d %10u %10u %8s %12.1f\n", conf->name, phases, (unsigned) min, (unsigned) max,
+		min == period && max == period && ordered ? "ok" : "FAIL",
+		(double) (host_clock_ns() - start) / TIMER_STEPS);
+
+	segdisp_stop(disp);
+	return min == period && max == period && ordered;
+}
+
+/* Runs the DMA refresh, checks the streamed port words against the GPIO refresh and measures the update path */
+static int bench_dma(const bench_conf_t *conf){
+	segdisp_t *disp = bench_display(conf);
+	int count = SEGDISP_DMA_WORDS(disp->ports_number, conf->digits);
+	uint32_t *words = calloc(count, sizeof(uint32_t));
+	uint32_t *prev = calloc(count, sizeof(uint32_t));
+	ioportmask_t streamed[SEGDISP_MAX_PORTS];
+	systime_t period;
+	uint64_t start;
+	double ns_set;
+	int rewritten = 0;
+	int ok = 1;
+	int i;
+	int p;
+
+	segdisp_set_str(disp, "0123456789ABCDEF");
+	disp->refresh = 1000;
+	period = US2ST(disp->refresh);
+	if(segdisp_run_dma(disp, &host_dma_backend, words) != 0){
+		printf("%-10s segdisp_run_dma failed\n", conf->name);
+		return 0;
+	}
+
+	/* every phase has to drive the ports exactly like the GPIO refresh */
+	for(i = 0; i < conf->digits; i++){
+		host_time_advance(period);
+		for(p = 0; p < disp->ports_number; p++){
+			streamed[p] = disp->ports[p].port->odr;
+		}
+		segdisp_show_digit(disp, i, disp->actual[i]);
+		for(p = 0; p < disp->ports_number; p++){
+			if(streamed[p] != disp->ports[p].port->odr)
+				ok = 0;
+		}
+	}
+
+	/* one changed digit rewrites one word per port */
+	memcpy(prev, words, count * sizeof(uint32_t));
+	segdisp_set(disp, conf->digits - 1, '-');
+	for(i = 0; i < count; i++){
+		if(prev[i] != words[i])
+			rewritten++;
+	}
+
+	start = host_clock_ns();
+	for(i = 0; i < UPDATE_ITERATIONS; i++){
+		segdisp_set(disp, i % conf->digits, (i & 1) ? '8' : '1');
+	}
+	ns_set = (double) (host_clock_ns() - start) / UPDATE_ITERATIONS;
+
+	start = host_clock_ns();
+	for(i = 0; i < UPDATE_ITERATIONS; i++){
+		segdisp_set_str(disp, (i & 1) ? "8888888888888888" : "1111111111111111");
+	}
+
+	printf("%-10s %11d %8s %10d %10.1f %12.1f\n", conf->name, count, ok ? "ok" : "FAIL", rewritten,
+		ns_set, (double) (host_clock_ns() - start) / UPDATE_ITERATIONS);
+
+	segdisp_stop(disp);
+	free(words);
+	free(prev);
+	return ok;
+}
+
+/* Runs six 4 digit displays from one manager thread, on disjoint pins or sharing the segment bus */
+#define MGR_DISPLAYS 6
+
+/* wiring of the managed displays, digits of display i are on GPIOG 4 * i and active low */
+static ioportid_t mgr_seg_port[MGR_DISPLAYS];
+static int mgr_seg_pin[MGR_DISPLAYS];
+static int mgr_number;
+static uint64_t mgr_lit_ns[MGR_DISPLAYS];
+static uint64_t mgr_since;
+static uint32_t mgr_lit;
+
+/* accumulates the host time every display has an enabled digit with some segment on */
+static void mgr_hook(ioportid_t port, ioportmask_t before, ioportmask_t after){
+	uint64_t now = host_clock_ns();
+	int i;
+
+	(void) port;
+	(void) before;
+	(void) after;
+	for(i = 0; i < mgr_number; i++){
+		if((mgr_lit >> i) & 1)
+			mgr_lit_ns[i] += now - mgr_since;
+	}
+	mgr_lit = 0;
+	for(i = 0; i < mgr_number; i++){
+		if((~GPIOG->odr >> (4 * i)) & 0xF && (mgr_seg_port[i]->odr >> mgr_seg_pin[i]) & 0xFF)
+			mgr_lit |= 1UL << i;
+	}
+	mgr_since = now;
+}
+
+/* Refreshes six displays by a manager, checks that each is lit for its share of the time */
+static int bench_mgr(int shared){
+	static const bench_conf_t conf = {"7seg x4", 0, 4};
+	segdisp_mgr_t mgr;
+	segdisp_t *disps[MGR_DISPLAYS];
+	unsigned long writes;
+	uint64_t total;
+	double share;
+	double min = 1.0;
+	int ok;
+	int i;
+
+	segdisp_mgr_init(&mgr);
+	mgr.refresh = 1000;
+	for(i = 0; i < MGR_DISPLAYS; i++){
+		mgr_seg_port[i] = shared || i < 3 ? GPIOA : GPIOB;
+		mgr_seg_pin[i] = shared ? 0 : 8 * (i % 3);
+		disps[i] = bench_display_at(&conf, mgr_seg_port[i], mgr_seg_pin[i], GPIOG, 4 * i);
+		segdisp_set_str(disps[i], "1234");
+		segdisp_mgr_add(&mgr, disps[i]);
+	}
+
+	memset(mgr_lit_ns, 0, sizeof(mgr_lit_ns));
+	mgr_number = MGR_DISPLAYS;
+	mgr_lit = 0;
+	mgr_since = host_clock_ns();
+	total = mgr_since;
+	host_pal_set_hook(mgr_hook);
+	host_pal_reset();
+	segdisp_mgr_run(&mgr, NORMALPRIO);
+	chThdSleepMilliseconds(200);
+	writes = host_pal_writes;
+	segdisp_mgr_stop(&mgr);
+	host_pal_set_hook(NULL);
+	total = host_clock_ns() - total;
+
+	/* every display is lit for its group's share of the time, minus the sleep overshoot */
+	for(i = 0; i < MGR_DISPLAYS; i++){
+		share = (double) mgr_lit_ns[i] * mgr.groups / total;
+		if(share < min)
+			min = share;
+	}
+	ok = min > 0.7;
+	printf("%-14s %8d %8d %10.1f %10lu %10.2f %8s\n", shared ? "shared bus" : "disjoint pins", mgr.number, mgr.groups,
+		segdisp_mgr_load(&mgr) / 10.0, writes * 5, min, ok ? "ok" : "FAIL");
+	return ok;
+}
+
+/* Stops one of two managed displays at various points of the phase, it has to stay dark */
+static int bench_mgr_stop(void){
+	static const bench_conf_t conf = {"7seg x4", 0, 4};
+	segdisp_mgr_t mgr;
+	segdisp_t *disps[2];
+	int ok = 1;
+	int n;
+	int i;
+
+	for(i = 0; i < 2; i++){
+		disps[i] = bench_display_at(&conf, GPIOA, 0, GPIOG, 4 * i);
+	}
+	for(n = 0; n < 20; n++){
+		segdisp_mgr_init(&mgr);
+		mgr.refresh = 200;
+		for(i = 0; i < 2; i++){
+			segdisp_set_str(disps[i], "8888");
+			segdisp_mgr_add(&mgr, disps[i]);
+		}
+		segdisp_mgr_run(&mgr, NORMALPRIO);
+		chThdSleepMicroseconds(1000 + 37 * n);
+		segdisp_stop(disps[0]);
+		chThdSleepMilliseconds(2);
+		/* digits of the display are active low */
+		ok &= disps[0]->refresh_mode == SEGDISP_REFRESH_STOPPED && (GPIOG->odr & 0xF) == 0xF;
+		segdisp_mgr_stop(&mgr);
+	}
+	printf("%-14s %8d %8d %10s %10s %10s %8s\n", "stop one", mgr.number, mgr.groups, "", "", "",
+		ok ? "ok" : "FAIL");
+	return ok;
+}
+
+/* One group with a dimmed and a full brightness display, the dimmed one has to keep its plane weights */
+static int bench_mgr_bcm(void){
+	static const bench_conf_t conf = {"7seg x4", 0, 4};
+	segdisp_mgr_t mgr;
+	segdisp_t *disps[2];
+	double ratio;
+	int ok;
+	int i;
+
+	segdisp_mgr_init(&mgr);
+	mgr.refresh = 15000;
+	for(i = 0; i < 2; i++){
+		mgr_seg_port[i] = GPIOA;
+		mgr_seg_pin[i] = 8 * i;
+		disps[i] = bench_display_at(&conf, GPIOA, 8 * i, GPIOG, 4 * i);
+		segdisp_set_str(disps[i], "8888");
+		segdisp_mgr_add(&mgr, disps[i]);
+	}
+	segdisp_set_global_brightness(disps[0], 8);
+
+	memset(mgr_lit_ns, 0, sizeof(mgr_lit_ns));
+	mgr_number = 2;
+	mgr_lit = 0;
+	mgr_since = host_clock_ns();
+	host_pal_set_hook(mgr_hook);
+	segdisp_mgr_run(&mgr, NORMALPRIO);
+	chThdSleepMilliseconds(300);
+	segdisp_mgr_stop(&mgr);
+	host_pal_set_hook(NULL);
+
+	ratio = (double) mgr_lit_ns[0] / mgr_lit_ns[1];
+	ok = mgr.groups == 1 && ratio > 0.45 && ratio < 0.62;
+	printf("%-14s %8d %8d %10s %10s %10.2f %8s\n", "level 8 + 15", mgr.number, mgr.groups, "", "", ratio,
+		ok ? "ok" : "FAIL");
+	return ok;
+}
+
+static systime_t lit_time[16];
+static systime_t lit_since;
+static int lit_digit;
+static int lit_digits;
+
+/* accumulates the time every digit is enabled, digits are active low on GPIOD */
+static void lit_hook(ioportid_t port, ioportmask_t before, ioportmask_t after){
+	systime_t now = chVTGetSystemTimeX();
+	int i;
+
+	(void) before;
+	if(port != GPIOD)
+		return;
+	if(lit_digit >= 0){
+		lit_time[lit_digit] += now - lit_since;
+	}
+	lit_digit = -1;
+	for(i = 0; i < lit_digits; i++){
+		if((after & PAL_PORT_BIT(i)) == 0)
+			lit_digit = i;
+	}
+	lit_since = now;
+}
+
+/* Runs the timer refresh with binary code modulation and checks the lit time of every digit,
+ * a refresh shorter than SEGDISP_BRIGHTNESS_MAX ticks has fewer planes and keeps its period */
+static int bench_brightness(int refresh, int global, const uint8_t *gamma){
+	static const bench_conf_t conf = {"7seg x4", 0, 4};
+	static const uint8_t levels[4] = {15, 8, 3, 0};
+	segdisp_t *disp = bench_display(&conf);
+	const int frames = 100;
+	systime_t base;
+	int max;
+	int ok = 1;
+	int i;
+
+	segdisp_set_str(disp, "8888");
+	disp->refresh = refresh;
+	for(i = 0; i < 4; i++){
+		segdisp_set_brightness(disp, i, levels[i]);
+	}
+	segdisp_set_global_brightness(disp, global);
+	segdisp_set_gamma(disp, gamma);
+	max = (1 << disp->bcm_planes) - 1;
+	base = US2ST(disp->refresh) / max;
+	ok &= base * max <= US2ST(disp->refresh);
+
+	memset(lit_time, 0, sizeof(lit_time));
+	lit_digit = -1;
+	lit_digits = conf.digits;
+	lit_since = chVTGetSystemTimeX();
+	host_pal_set_hook(lit_hook);
+	/* the first step is done one tick after the start */
+	segdisp_run_timer(disp);
+	host_time_advance(1 + frames * base * max * conf.digits);
+	host_pal_set_hook(NULL);
+
+	printf("%7d %6d %6s %6d", refresh, global, gamma != NULL ? "yes" : "no", disp->steps_number);
+	for(i = 0; i < 4; i++){
+		int level = levels[i] * global / SEGDISP_BRIGHTNESS_MAX;
+		if(gamma != NULL){
+			level = gamma[level];
+		}
+		level = (level * max + SEGDISP_BRIGHTNESS_MAX / 2) / SEGDISP_BRIGHTNESS_MAX;
+		printf(" %6.2f/%-3d", (double) lit_time[i] / frames / base, level);
+		if(lit_time[i] != (systime_t) (frames * level * base))
+			ok = 0;
+	}
+	printf(" %6s\n", ok ? "ok" : "FAIL");
+
+	segdisp_stop(disp);
+	return ok;
+}
+
+static volatile bool writer_stop;
+
+/* Writer hammering the display while the refresh runs */
+static THD_FUNCTION(stats_writer, arg) {
+	segdisp_t *disp = arg;
+	int i = 0;
+
+	while(!writer_stop){
+		segdisp_set_str(disp, (i++ & 1) ? "1234" : "5678");
+		segdisp_move_cont(disp, 1);
+	}
+}
+
+/* Reads the statistics of a running thread refresh while a writer updates the display */
+static void bench_stats(void){
+	static const bench_conf_t conf = {"7seg x4", 0, 4};
+	segdisp_t *disp = bench_display(&conf);
+	segdisp_stats_t st;
+	thread_t *writer;
+
+	disp->refresh = 1000;
+	segdisp_set_str(disp, "8888");
+	host_systick_start();
+	segdisp_run(disp, NORMALPRIO);
+	writer_stop = false;
+	writer = chThdCreateFromHeap(NULL, THD_WORKING_AREA_SIZE(256), NORMALPRIO, stats_writer, disp);
+	chThdSleepMilliseconds(1200);
+	segdisp_stats_get(disp, &st);
+	writer_stop = true;
+	chThdWait(writer);
+	segdisp_stop(disp);
+	host_systick_stop();
+
+	printf("frames %lu, steps %lu, fps %lu\n", (unsigned long) st.frames, (unsigned long) st.steps, (unsigned long) st.fps);
+	printf("on-time min/avg/max %.1f/%.1f/%.1f us, worst frame interval %.1f us\n",
+		st.on_min / 1000.0, st.on_count ? (double) st.on_sum / st.on_count / 1000.0 : 0.0, st.on_max / 1000.0,
+		st.frame_max / 1000.0);
+	printf("show time %.1f ns/step, scroll steps %lu\n", st.steps ? (double) st.show_time / st.steps : 0.0,
+		(unsigned long) st.scroll_steps);
+	printf("writer blocked %lu times, total %.1f us, worst %.1f us\n", (unsigned long) st.lock_blocked,
+		st.lock_wait / 1000.0, st.lock_wait_max / 1000.0);
+}
+
+/* Repeated and partially changed updates, only the changed cells get written and published */
+static int bench_dirty(const bench_conf_t *conf){
+	segdisp_t *disp = bench_display(conf);
+	char text[2][SEGDISP_MAX_SEGMENTS + 1];
+	uint32_t touched;
+	uint32_t skipped;
+	uint64_t start;
+	double same;
+	double one;
+	int i;
+
+	memset(text[0], '8', conf->digits);
+	text[0][conf->digits] = 0;
+	memcpy(text[1], text[0], conf->digits + 1);
+	text[1][conf->digits - 1] = '1';
+
+	segdisp_set_str(disp, text[0]);
+	touched = disp->touched_total;
+	skipped = disp->updates_skipped;
+	start = host_clock_ns();
+	for(i = 0; i < UPDATE_ITERATIONS; i++){
+		segdisp_set_str(disp, text[0]);
+	}
+	same = (double) (host_clock_ns() - start) / UPDATE_ITERATIONS;
+	skipped = disp->updates_skipped - skipped;
+
+	start = host_clock_ns();
+	for(i = 0; i < UPDATE_ITERATIONS; i++){
+		segdisp_set_str(disp, text[(i + 1) & 1]);
+	}
+	one = (double) (host_clock_ns() - start) / UPDATE_ITERATIONS;
+	touched = disp->touched_total - touched;
+
+	printf("%-10s %10.1f %10.1f %10lu %12.2f\n", conf->name, same, one, (unsigned long) skipped,
+		(double) touched / UPDATE_ITERATIONS);
+	return skipped == UPDATE_ITERATIONS && touched == UPDATE_ITERATIONS;
+}
+
+static const SPIConfig spi_conf = {segdisp_595_end_cb};
+
+/* Display without GPIO pins driven by the given backend */
+static segdisp_t *bench_display_unwired(int segments, int digits, const segdisp_backend_t *backend){
+	segdisp_t *disp = calloc(1, sizeof(segdisp_t));
+
+	if(segdisp_init(disp, pins_alloc(segments), pins_alloc(digits), SEGDISP_SEGMENTS_SEVEN) != 0 ||
+		segdisp_set_backend(disp, backend) != 0){
+		fprintf(stderr, "segdisp_init failed for unwired display\n");
+		exit(1);
+	}
+	return disp;
+}
+
+/* Display with 8 segments and the digits on a chain of two registers of SPID1, segments on outputs 0..7 */
+static segdisp_t *bench_display_595(segdisp_595_t *sr, int digits, uint64_t invert){
+	segdisp_t *disp = bench_display_unwired(8, digits, &host_mock_backend);
+
+	if(segdisp_595_init(sr, disp, &SPID1, 2, 8, invert) != 0 || segdisp_set_backend(disp, &sr->backend) != 0){
+		fprintf(stderr, "segdisp_595_init failed\n");
+		exit(1);
+	}
+	return disp;
+}
+
+static uint32_t mgr_spi_seen;
+
+/* latches the chain and notes which display's glyph got to the outputs with a digit enabled */
+static void mgr_spi_end_cb(SPIDriver *spip){
+	int i;
+
+	segdisp_595_end_cb(spip);
+	for(i = 0; i < 2; i++){
+		if((spip->latched & 0xF00) != 0 && (spip->latched & 0xFF) == segdisp_font_7seg[(uint8_t) "12"[i]])
+			mgr_spi_seen |= 1UL << i;
+	}
+}
+
+/* Two shift register chains on one SPI driver have to take turns in the manager, with the transfers
+ * taking a tick no phase may be refused because of the blank of the previous group */
+static int bench_mgr_spi(void){
+	static const SPIConfig conf = {mgr_spi_end_cb};
+	static segdisp_595_t sr[2];
+	segdisp_mgr_t mgr;
+	segdisp_t *disps[2];
+	uint32_t overruns;
+	int ok;
+	int i;
+
+	spiStart(&SPID1, &conf);
+	segdisp_mgr_init(&mgr);
+	mgr.refresh = 1000;
+	for(i = 0; i < 2; i++){
+		disps[i] = bench_display_595(&sr[i], 4, 0);
+		segdisp_set_str(disps[i], i == 0 ? "1111" : "2222");
+		segdisp_mgr_add(&mgr, disps[i]);
+	}
+
+	mgr_spi_seen = 0;
+	SPID1.delay = 1;
+	host_systick_start();
+	segdisp_mgr_run(&mgr, NORMALPRIO);
+	chThdSleepMilliseconds(50);
+	overruns = sr[0].overruns + sr[1].overruns;
+	segdisp_mgr_stop(&mgr);
+	host_systick_stop();
+	host_time_advance(1);
+	spiStart(&SPID1, &spi_conf);
+
+	ok = mgr.groups == 2 && overruns == 0 && mgr_spi_seen == 3;
+	printf("%-14s %8d %8d %10s %10s %10s %8s\n", "shared SPI", mgr.number, mgr.groups, "", "", "",
+		ok ? "ok" : "FAIL");
+	return ok;
+}
+
+/* Cost of one phase with a backend */
+static double bench_phase(segdisp_t *disp){
+	uint64_t start = host_clock_ns();
+	int i;
+
+	for(i = 0; i < STEP_ITERATIONS; i++){
+		int position = i % disp->digits->number;
+		segdisp_show_digit(disp, position, disp->actual[position]);
+	}
+	return (double) (host_clock_ns() - start) / STEP_ITERATIONS;
+}
+
+/* The same frame through the GPIO, shift register and mock backends */
+static int bench_backends(void){
+	static const bench_conf_t conf = {"7seg x4", 0, 4};
+	static segdisp_595_t sr;
+	segdisp_t *gpio = bench_display(&conf);
+	segdisp_t *spi;
+	segdisp_t *mock;
+	unsigned long writes;
+	unsigned long transfers;
+	double t;
+	int mock_ok = 1;
+	int spi_ok;
+	int i;
+	segdisp_595_t wide;
+
+	/* segments on outputs 0..7, digits on 8..11 driven low */
+	spiStart(&SPID1, &spi_conf);
+	spi = bench_display_595(&sr, 4, 0xF00);
+	mock = bench_display_unwired(8, 4, &host_mock_backend);
+	segdisp_set_str(gpio, "0123");
+	segdisp_set_str(spi, "0123");
+	segdisp_set_str(mock, "0123");
+
+	host_pal_reset();
+	segdisp_show_digit(gpio, 0, gpio->actual[0]);
+	writes = host_pal_writes;
+	t = bench_phase(gpio);
+	printf("%-8s %14lu %14s %10.1f %8s\n", "gpio", writes, "-", t, "ok");
+
+	transfers = SPID1.transfers;
+	segdisp_show_digit(spi, 2, spi->actual[2]);
+	transfers = SPID1.transfers - transfers;
+	spi_ok = (SPID1.latched & 0xFFFF) == ((((uint64_t) 1 << 2) << 8 | segdisp_font_7seg['2']) ^ 0xF00);
+	segdisp_blank(spi);
+	spi_ok &= (SPID1.latched & 0xFFFF) == 0xF00;
+	/* displays that don't fit to the chain are refused */
+	spi_ok &= segdisp_595_init(&wide, spi, &SPID1, 2, 7, 0) != 0 && segdisp_595_init(&wide, spi, &SPID1, 1, 8, 0) != 0;
+	t = bench_phase(spi);
+	printf("%-8s %14lu %14lu %10.1f %8s\n", "74hc595", 0UL, transfers, t, spi_ok ? "ok" : "FAIL");
+
+	mock->refresh = 1000;
+	host_mock_reset();
+	segdisp_run_timer(mock);
+	host_time_advance(US2ST(mock->refresh) * 2 * conf.digits);
+	segdisp_stop(mock);
+	for(i = 0; i < 2 * conf.digits; i++){
+		mock_ok &= host_mock_phases[i].digit_mask == (1UL << (i % conf.digits)) &&
+			host_mock_phases[i].segments == segdisp_font_7seg[(uint8_t) "0123"[i % conf.digits]];
+	}
+	mock_ok &= host_mock_count >= (unsigned long) (2 * conf.digits);
+	t = bench_phase(mock);
+	printf("%-8s %14s %14s %10.1f %8s\n", "mock", "-", "-", t, mock_ok ? "ok" : "FAIL");
+
+	return spi_ok && mock_ok;
+}
+
+/* One frame of a wide panel recorded by the mock backend, the phases have to add up to the shown codes */
+static int bench_axis(int digits, uint8_t axis, int dimmed){
+	segdisp_t *disp = calloc(1, sizeof(segdisp_t));
+	uint32_t shown[SEGDISP_MAX_DIGITS] = {0};
+	uint32_t lit = 0;
+	unsigned long phases;
+	systime_t frame = 0;
+	char duty[16];
+	int ok = 1;
+	int d;
+	unsigned long i;
+
+	if(segdisp_init(disp, pins_alloc(8), pins_alloc(digits), SEGDISP_SEGMENTS_SEVEN | axis) != 0 ||
+		segdisp_set_backend(disp, &host_mock_backend) != 0){
+		fprintf(stderr, "segdisp_init failed for axis check\n");
+		exit(1);
+	}
+	segdisp_set_str(disp, "8.1.2.3.4.5.6.7.89ABCDEF0123");
+	if(dimmed){
+		segdisp_set_brightness(disp, 0, 0);
+	}
+	disp->refresh = 1000;
+
+	host_mock_reset();
+	segdisp_run_timer(disp);
+	host_time_advance(1);
+	phases = host_mock_count;
+	/* one whole frame after the first phase */
+	for(i = 0; i < (unsigned long) disp->steps_number; i++){
+		frame += disp->steps[i].ticks;
+	}
+	host_time_advance(frame - 1);
+	phases = host_mock_count - phases + 1;
+	segdisp_stop(disp);
+
+	for(i = 0; i < phases; i++){
+		const host_phase_t *p = &host_mock_phases[i];
+		for(d = 0; d < digits; d++){
+			if(p->digit_mask & (1UL << d)){
+				shown[d] |= p->segments;
+				lit++;
+			}
+		}
+	}
+	for(d = 0; d < digits; d++){
+		uint32_t expected = dimmed && d == 0 ? 0 : disp->actual[d] & disp->seg_mask;
+		ok &= shown[d] == expected;
+	}
+
+	snprintf(duty, sizeof(duty), dimmed ? "-" : "%.3f", (double) lit / phases / digits);
+	printf("%-8s %6d %8s %8lu %12s %8s\n", dimmed ? "dimmed" : "full", digits,
+		disp->axis == SEGDISP_AXIS_SEGMENTS ? "segments" : "digits", (unsigned long) disp->steps_number,
+		duty, ok ? "ok" : "FAIL");
+	return ok;
+}
+
+/* Compares the front buffer with the text, '.' lights the decimal point of the previous digit */
+static int shows_number(segdisp_t *disp, const char *text){
+	uint32_t codes[SEGDISP_MAX_DIGITS];
+	int n = 0;
+
+	for(; *text != '\0'; text++){
+		if(*text == '.' && n > 0){
+			codes[n - 1] |= disp->font['.'];
+		}
+		else{
+			codes[n++] = disp->font[(uint8_t) *text];
+		}
+	}
+	return n == disp->digits->number && memcmp(codes, disp->actual, n * sizeof(uint32_t)) == 0;
+}
+
+/* Numeric rendering cases and the cost compared to formatting a string */
+/* Digit 0 showing 1 with the given polarity flags, the port levels are compared with the expected ones */
+static int bench_polarity(uint32_t flags, const char *name, uint32_t seg_on, uint32_t dig_on){
+	static const bench_conf_t conf = {"7seg x2", 0, 2};
+	segdisp_t *disp = bench_display(&conf);
+	uint32_t segs;
+	uint32_t digs;
+	int ok;
+
+	ok = segdisp_init(disp, disp->segments, disp->digits, SEGDISP_SEGMENTS_SEVEN | flags) == 0;
+	segdisp_set_str(disp, "11");
+	segdisp_show_digit(disp, 0, disp->actual[0]);
+	segs = GPIOA->odr & 0xFF;
+	digs = GPIOD->odr & 0b11;
+	ok &= segs == seg_on && digs == dig_on;
+
+	printf("%-20s %10lx %10lx %8s\n", name, (unsigned long) segs, (unsigned long) digs, ok ? "ok" : "FAIL");
+	return ok;
+}
+
+static int bench_numbers(void){
+	static const bench_conf_t conf = {"7seg x4", 0, 4};
+	segdisp_t *disp = bench_display(&conf);
+	char text[16];
+	uint64_t start;
+	double direct;
+	double staged;
+	int ok = 1;
+	int i;
+
+	ok &= segdisp_set_int(disp, 42, 0) == 0 && shows_number(disp, "  42");
+	ok &= segdisp_set_int(disp, -42, SEGDISP_NUM_ZEROS) == 0 && shows_number(disp, "-042");
+	ok &= segdisp_set_int(disp, 42, SEGDISP_NUM_LEFT) == 0 && shows_number(disp, "42  ");
+	ok &= segdisp_set_int(disp, 12345, 0) == 1 && shows_number(disp, "----");
+	ok &= segdisp_set_int(disp, -999, 0) == 0 && shows_number(disp, "-999");
+	ok &= segdisp_set_fixed(disp, 1234, 2, 0) == 0 && shows_number(disp, "12.34");
+	ok &= segdisp_set_fixed(disp, 5, 2, 0) == 0 && shows_number(disp, " 0.05");
+	ok &= segdisp_set_fixed(disp, -5, 1, 0) == 0 && shows_number(disp, " -0.5");
+	ok &= segdisp_set_fixed(disp, 5, 4, 0) == -1;
+	ok &= segdisp_set_hex(disp, 0xBEEF, 0) == 0 && shows_number(disp, "BEEF");
+	ok &= segdisp_set_hex(disp, 0x1F, SEGDISP_NUM_ZEROS) == 0 && shows_number(disp, "001F");
+	ok &= segdisp_set_hex(disp, 0x12345, 0) == 1;
+
+	start = host_clock_ns();
+	for(i = 0; i < UPDATE_ITERATIONS; i++){
+		segdisp_set_fixed(disp, i % 10000, 2, 0);
+	}
+	direct = (double) (host_clock_ns() - start) / UPDATE_ITERATIONS;
+
+	start = host_clock_ns();
+	for(i = 0; i < UPDATE_ITERATIONS; i++){
+		snprintf(text, sizeof(text), "%4d", i % 10000);
+		segdisp_set_str(disp, text);
+	}
+	staged = (double) (host_clock_ns() - start) / UPDATE_ITERATIONS;
+
+	printf("%-10s %14.1f %14.1f %8s\n", conf.name, direct, staged, ok ? "ok" : "FAIL");
+	return ok;
+}
+
+/* Wiring of the benchmarked displays for the fixed backends */
+#define BENCH_DIGITS8(X, a, b) \
+	X(0, GPIOD, 0, a, b) X(1, GPIOD, 1, a, b) X(2, GPIOD, 2, a, b) X(3, GPIOD, 3, a, b) \
+	X(4, GPIOD, 4, a, b) X(5, GPIOD, 5, a, b) X(6, GPIOD, 6, a, b) X(7, GPIOD, 7, a, b)
+#define BENCH_SEG7(X, a, b) \
+	X(0, GPIOA, 0, a, b) X(1, GPIOA, 1, a, b) X(2, GPIOA, 2, a, b) X(3, GPIOA, 3, a, b) \
+	X(4, GPIOA, 4, a, b) X(5, GPIOA, 5, a, b) X(6, GPIOA, 6, a, b) X(7, GPIOA, 7, a, b)
+#define BENCH_SEG16(X, a, b) \
+	X(0, GPIOE, 10, a, b) X(1, GPIOE, 7, a, b) X(2, GPIOE, 6, a, b) X(3, GPIOE, 2, a, b) \
+	X(4, GPIOC, 15, a, b) X(5, GPIOE, 0, a, b) X(6, GPIOC, 14, a, b) X(7, GPIOE, 13, a, b) \
+	X(8, GPIOE, 11, a, b) X(9, GPIOE, 4, a, b) X(10, GPIOE, 15, a, b) X(11, GPIOE, 9, a, b) \
+	X(12, GPIOE, 8, a, b) X(13, GPIOE, 3, a, b) X(14, GPIOE, 12, a, b) X(15, GPIOE, 14, a, b) \
+	X(16, GPIOC, 13, a, b)
+#define BENCH_PORTS7(X, a, b, c) X(GPIOD, a, b, c) X(GPIOA, a, b, c)
+#define BENCH_PORTS16(X, a, b, c) X(GPIOD, a, b, c) X(GPIOE, a, b, c) X(GPIOC, a, b, c)
+
+SEGDISP_FIXED_BACKEND(fixed7_backend, BENCH_PORTS7, BENCH_SEG7, BENCH_DIGITS8, SEGDISP_SEGMENTS_SEVEN);
+SEGDISP_FIXED_BACKEND(fixed16_backend, BENCH_PORTS16, BENCH_SEG16, BENCH_DIGITS8, SEGDISP_SEGMENTS_SIXTEEN);
+
+/* Port levels after every phase of the generic and the fixed backend have to match */
+static int bench_fixed(const bench_conf_t *conf, const segdisp_backend_t *fixed){
+	segdisp_t *disp = bench_display(conf);
+	ioportmask_t levels[HOST_PORTS_NUMBER];
+	double generic;
+	double t;
+	int ok = 1;
+	int i;
+	int p;
+
+	segdisp_set_str(disp, "8.1.2.3.A.B.C.D.");
+	for(i = 0; i < conf->digits; i++){
+		segdisp_show_digit(disp, i, disp->actual[i]);
+		for(p = 0; p < HOST_PORTS_NUMBER; p++){
+			levels[p] = host_ports[p].odr;
+		}
+		segdisp_set_backend(disp, fixed);
+		segdisp_show_digit(disp, i, disp->actual[i]);
+		for(p = 0; p < HOST_PORTS_NUMBER; p++){
+			ok &= levels[p] == host_ports[p].odr;
+		}
+		segdisp_set_backend(disp, &segdisp_gpio_backend);
+	}
+
+	generic = bench_phase(disp);
+	segdisp_set_backend(disp, fixed);
+	t = bench_phase(disp);
+
+	printf("%-10s %12.1f %12.1f %8s\n", conf->name, generic, t, ok ? "ok" : "FAIL");
+	return ok;
+}
+
+SEGDISP_STORAGE(lifecycle_storage, 4, 16);
+
+/* Repeated init, run, update, scroll and stop cycles, counts the allocations */
+static int bench_lifecycle(int use_static){
+	static const bench_conf_t conf = {"7seg x4", 0, 4};
+	segdisp_t *disp = bench_display(&conf);
+	unsigned long allocs;
+	long heap = host_heap_blocks;
+	int ok = 1;
+	int i;
+
+	host_systick_start();
+	allocs = host_allocs;
+	for(i = 0; i < LIFECYCLES; i++){
+		if(use_static){
+			ok &= segdisp_init_static(disp, disp->segments, disp->digits, SEGDISP_SEGMENTS_SEVEN, &lifecycle_storage) == 0;
+		}
+		else{
+			ok &= segdisp_init(disp, disp->segments, disp->digits, SEGDISP_SEGMENTS_SEVEN) == 0;
+		}
+		disp->refresh = 250;
+		ok &= segdisp_run(disp, NORMALPRIO) == 0;
+		ok &= segdisp_set_str(disp, "0123456789ABCDEF") == 0;
+		ok &= segdisp_scroll_run(disp, NORMALPRIO) == 0;
+		segdisp_stop(disp);
+		/* the next init must not find the scroll timer still armed */
+		ok &= disp->thread == NULL && !disp->scroll_running && !chVTIsArmedI(&disp->scroll_timer);
+	}
+	allocs = host_allocs - allocs;
+	host_systick_stop();
+
+	/* the message buffer taken by segdisp_set_str is returned by segdisp_stop */
+	ok &= host_heap_blocks == heap;
+	/* segdisp_init takes new core memory each time, only the static storage can be cycled for free */
+	if(use_static){
+		ok &= allocs == 0;
+	}
+	printf("%-8s %8d %14.1f %8s\n", use_static ? "static" : "dynamic", LIFECYCLES, (double) allocs / LIFECYCLES,
+		ok ? "ok" : "FAIL");
+	return ok;
+}
+
+/* 7 segment display with inverted segment drivers and a font with the polarity applied */
+static segdisp_t *bench_display_polarized(void){
+	static uint32_t font[256];
+	segdisp_t *disp = calloc(1, sizeof(segdisp_t));
+	segdisp_pins_t *segments = pins_alloc(8);
+	segdisp_pins_t *digits = pins_alloc(4);
+	int i;
+
+	for(i = 0; i < 8; i++){
+		segments->pins[i].port = GPIOA;
+		segments->pins[i].pin = i;
+	}
+	for(i = 0; i < 4; i++){
+		digits->pins[i].port = GPIOD;
+		digits->pins[i].pin = i;
+	}
+	if(segdisp_init(disp, segments, digits, SEGDISP_SEGMENTS_SEVEN | SEGDISP_INVERTED_DRIVER) != 0){
+		fprintf(stderr, "segdisp_init failed for polarized display\n");
+		exit(1);
+	}
+	segdisp_font_polarize(disp, font, segdisp_font_7seg);
+	segdisp_set_font(disp, font, 1);
+	return disp;
+}
+
+/* Traces the pins of a timer refreshed display and compares the perceived frame with the font */
+static int bench_sim(const char *name, segdisp_t *disp, const char *text){
+	static host_sim_event_t events[4096];
+	static host_sim_t sim;
+	uint32_t codes[SEGDISP_MAX_DIGITS];
+	host_sim_metrics_t m;
+	systime_t lit_min = ~(systime_t) 0;
+	systime_t lit_max = 0;
+	systime_t start;
+	systime_t end;
+	FILE *vcd = tmpfile();
+	int blank_ok;
+	int ok;
+	int i;
+
+	if(host_sim_attach(&sim, disp, events, sizeof(events) / sizeof(events[0])) != 0){
+		fprintf(stderr, "host_sim_attach failed for %s\n", name);
+		exit(1);
+	}
+	disp->refresh = 1000;
+
+	/* before the first update the display is dark, also after segdisp_set_font; the font can't change while running */
+	segdisp_run_timer(disp);
+	host_sim_clear(&sim);
+	start = chVTGetSystemTimeX();
+	host_time_advance(US2ST(disp->refresh) * disp->digits->number);
+	host_sim_glyphs(&sim, start, chVTGetSystemTimeX(), codes);
+	blank_ok = segdisp_set_font(disp, disp->font, disp->font_polarized) != 0;
+	for(i = 0; i < disp->digits->number; i++){
+		blank_ok &= codes[i] == 0;
+	}
+	segdisp_stop(disp);
+
+	segdisp_set_str(disp, text);
+	segdisp_run_timer(disp);
+	host_time_advance(US2ST(disp->refresh) * disp->digits->number);
+	host_sim_clear(&sim);
+	start = chVTGetSystemTimeX();
+	host_time_advance(US2ST(disp->refresh) * disp->digits->number * 10);
+	end = chVTGetSystemTimeX();
+	segdisp_stop(disp);
+
+	host_sim_metrics(&sim, start, end, &m);
+	host_sim_glyphs(&sim, start, end, codes);
+	/* the stopped display leaves all the segments off */
+	ok = blank_ok && m.frames == 10 && m.ghosts == 0 && sim.dropped == 0 && sim.state_segments == 0;
+	for(i = 0; i < disp->digits->number; i++){
+		ok &= codes[i] == ((disp->font[(uint8_t) text[i]] ^ disp->seg_invert) & disp->seg_mask);
+		if(m.lit[i] < lit_min)
+			lit_min = m.lit[i];
+		if(m.lit[i] > lit_max)
+			lit_max = m.lit[i];
+	}
+	ok &= vcd != NULL && host_sim_vcd(&sim, vcd) == 0 && ftell(vcd) > 0;
+	if(vcd != NULL)
+		fclose(vcd);
+	host_sim_detach(&sim);
+
+	printf("%-10s %10.1f %10.1f %10.1f %10.1f %8s\n", name, (double) m.toggles / m.frames, (double) m.overlaps / m.frames,
+		100.0 * lit_min / (end - start), 100.0 * lit_max / (end - start), ok ? "ok" : "FAIL");
+	return ok;
+}
+
+/* Timer refresh of a text, counts the port writes done and avoided per frame and the shift register transfers */
+static int bench_delta(const char *text){
+	static const bench_conf_t conf = {"7seg x8", 0, 8};
+	static segdisp_595_t sr;
+	segdisp_t *disp = bench_display(&conf);
+	segdisp_t *spi;
+	systime_t frame;
+	unsigned long writes;
+	uint32_t avoided;
+	unsigned long transfers;
+	uint32_t skipped;
+	int ok;
+
+	disp->refresh = 1000;
+	frame = US2ST(disp->refresh) * conf.digits;
+	segdisp_set_str(disp, text);
+	segdisp_run_timer(disp);
+	host_time_advance(frame);
+	host_pal_reset();
+	avoided = disp->writes_avoided;
+	host_time_advance(frame * 10);
+	writes = host_pal_writes;
+	avoided = disp->writes_avoided - avoided;
+	segdisp_stop(disp);
+
+	spiStart(&SPID1, &spi_conf);
+	spi = bench_display_595(&sr, conf.digits, 0);
+	spi->refresh = 1000;
+	segdisp_set_str(spi, text);
+	segdisp_run_timer(spi);
+	host_time_advance(frame);
+	transfers = SPID1.transfers;
+	skipped = sr.skipped;
+	host_time_advance(frame * 10);
+	transfers = SPID1.transfers - transfers;
+	skipped = sr.skipped - skipped;
+	segdisp_stop(spi);
+
+	/* two ports per phase, the digit port changes in every phase */
+	ok = writes + avoided == 10UL * 2 * conf.digits && writes >= 10UL * conf.digits && transfers + skipped == 10UL * conf.digits;
+	printf("%-10s %10.1f %10.1f %10.1f %10.1f %8s\n", text, writes / 10.0, avoided / 10.0, transfers / 10.0, skipped / 10.0,
+		ok ? "ok" : "FAIL");
+	return ok;
+}
+
+/* Timer refresh of a text with the dark digits shown or skipped, then of a dark display and of the text again */
+static int bench_blank(const char *text, uint8_t blank){
+	static const bench_conf_t conf = {"7seg x6", 0, 6};
+	static host_sim_event_t events[4096];
+	static host_sim_t sim;
+	segdisp_t *disp = bench_display(&conf);
+	uint32_t codes[SEGDISP_MAX_DIGITS];
+	host_sim_metrics_t m;
+	systime_t lit_max = 0;
+	systime_t frame;
+	systime_t start;
+	systime_t end;
+	unsigned long dark_writes;
+	int lit = 0;
+	int ok;
+	int i;
+
+	if(segdisp_init(disp, disp->segments, disp->digits, SEGDISP_SEGMENTS_SEVEN | blank) != 0 ||
+		host_sim_attach(&sim, disp, events, sizeof(events) / sizeof(events[0])) != 0){
+		fprintf(stderr, "bench_blank: init failed\n");
+		exit(1);
+	}
+	disp->refresh = 1000;
+	frame = US2ST(disp->refresh) * conf.digits;
+	segdisp_set_str(disp, text);
+	segdisp_run_timer(disp);
+	host_time_advance(frame);
+	host_sim_clear(&sim);
+	start = chVTGetSystemTimeX();
+	host_time_advance(frame * 10);
+	end = chVTGetSystemTimeX();
+
+	host_sim_metrics(&sim, start, end, &m);
+	host_sim_glyphs(&sim, start, end, codes);
+	ok = sim.dropped == 0;
+	for(i = 0; i < conf.digits; i++){
+		ok &= codes[i] == (disp->font[(uint8_t) text[i]] & disp->seg_mask);
+		if(codes[i] != 0){
+			lit++;
+		}
+		if(m.lit[i] > lit_max)
+			lit_max = m.lit[i];
+	}
+	/* the frame period stays, skipped phases give their time to the lit digits */
+	if(blank == SEGDISP_BLANK_SKIPPED){
+		ok &= m.frames == 10 && m.phases == 10UL * lit && lit_max * lit >= (end - start) * 49 / 50;
+	}
+	else{
+		ok &= m.frames == 10 && m.phases == 10UL * conf.digits && lit_max * conf.digits >= (end - start) * 49 / 50;
+	}
+
+	/* dark display, the skipping refresh stops until the next update */
+	segdisp_set_str(disp, " ");
+	host_time_advance(frame * 2);
+	host_pal_reset();
+	host_time_advance(frame * 10);
+	dark_writes = host_pal_writes;
+	if(blank == SEGDISP_BLANK_SKIPPED){
+		ok &= dark_writes == 0 && disp->idle && !chVTIsArmedI(&disp->timer) && disp->idle_count == 1;
+	}
+	else{
+		ok &= dark_writes != 0 && !disp->idle;
+	}
+	segdisp_set_str(disp, text);
+	host_time_advance(frame * 2);
+	ok &= !disp->idle && host_pal_writes != dark_writes;
+	segdisp_stop(disp);
+	host_sim_detach(&sim);
+
+	printf("%-8s %-8s %10.1f %10.1f %10.1f %8s\n", text, blank == SEGDISP_BLANK_SKIPPED ? "skipped" : "shown",
+		(double) m.phases / m.frames, 100.0 * lit_max / (end - start), dark_writes / 10.0, ok ? "ok" : "FAIL");
+	return ok;
+}
+
+/* Thread refresh of a dark display, the thread has to wait for the next update and stop when woken */
+static int bench_blank_thread(void){
+	static const bench_conf_t conf = {"7seg x6", 0, 6};
+	segdisp_t *disp = bench_display(&conf);
+	unsigned long dark_writes;
+	int ok;
+
+	ok = segdisp_init(disp, disp->segments, disp->digits, SEGDISP_SEGMENTS_SEVEN | SEGDISP_BLANK_SKIPPED) == 0;
+	disp->refresh = 250;
+	host_systick_start();
+	ok &= segdisp_run(disp, NORMALPRIO) == 0;
+	segdisp_set_str(disp, "    12");
+	chThdSleepMilliseconds(10);
+	segdisp_set_str(disp, " ");
+	chThdSleepMilliseconds(10);
+	ok &= disp->idle && disp->idle_thread != NULL;
+	host_pal_reset();
+	chThdSleepMilliseconds(20);
+	dark_writes = host_pal_writes;
+	segdisp_set_str(disp, "     3");
+	chThdSleepMilliseconds(10);
+	ok &= !disp->idle && host_pal_writes != dark_writes;
+	segdisp_set_str(disp, " ");
+	chThdSleepMilliseconds(10);
+	ok &= disp->idle;
+	segdisp_stop(disp);
+	host_systick_stop();
+	ok &= disp->thread == NULL && dark_writes == 0;
+
+	printf("%-8s %-8s %10s %10s %10.1f %8s\n", "thread", "skipped", "", "", (double) dark_writes, ok ? "ok" : "FAIL");
+	return ok;
+}
+
+#define KEY_DIGITS 4
+#define KEY_RETURNS 2
+#define KEY_DEBOUNCE 3
+
+/* pressed keys of the simulated matrix, bit i is the key i */
+static volatile uint32_t keys_down;
+
+/* Key matrix between the digit lines (GPIOD, enabled low) and the return lines (GPIOC, pulled up) */
+static void keys_hook(ioportid_t port, ioportmask_t before, ioportmask_t after){
+	ioportmask_t levels = PAL_GROUP_MASK(KEY_RETURNS);
+	int d;
+	int j;
+
+	(void) before;
+	if(port != GPIOD)
+		return;
+	for(d = 0; d < KEY_DIGITS; d++){
+		if((after >> d) & 1)
+			continue;
+		for(j = 0; j < KEY_RETURNS; j++){
+			if((keys_down >> (d * KEY_RETURNS + j)) & 1)
+				levels &= ~PAL_PORT_BIT(j);
+		}
+	}
+	GPIOC->idr = levels;
+}
+
+/* Changes the pressed keys, the return lines follow at once */
+static void keys_set(uint32_t down){
+	keys_down = down;
+	keys_hook(GPIOD, GPIOD->odr, GPIOD->odr);
+}
+
+/* Fetches the next key message, -1 if there's none */
+static msg_t keys_fetch(mailbox_t *mbox){
+	msg_t msg;
+	msg_t ret;
+
+	chSysLock();
+	ret = chMBFetchI(mbox, &msg);
+	chSysUnlock();
+	return ret == MSG_OK ? msg : -1;
+}
+
+/* Checks that the mailbox holds exactly the given messages, digits are reported in the order of their scan */
+static int keys_expect(mailbox_t *mbox, const msg_t *msgs, int number){
+	uint32_t seen = 0;
+	msg_t msg;
+	int i;
+
+	while((msg = keys_fetch(mbox)) != -1){
+		for(i = 0; i < number && msgs[i] != msg; i++){
+		}
+		if(i == number || ((seen >> i) & 1))
+			return 0;
+		seen |= 1UL << i;
+	}
+	return seen == (1UL << number) - 1;
+}
+
+/* Scans keys on a timer refreshed display and checks the debounced messages, events and states */
+static int bench_keys(const char *text){
+	static const bench_conf_t conf = {"7seg x4", 0, KEY_DIGITS};
+	static uint32_t storage[SEGDISP_KEYS_WORDS(KEY_DIGITS)];
+	static msg_t buffer[8];
+	static mailbox_t mbox;
+	static const msg_t both[] = {SEGDISP_KEY_MSG(0, 1), SEGDISP_KEY_MSG(5, 0), SEGDISP_KEY_MSG(7, 1)};
+	static const msg_t released[] = {SEGDISP_KEY_MSG(0, 0), SEGDISP_KEY_MSG(7, 0)};
+	segdisp_t *disp = bench_display(&conf);
+	segdisp_pins_t *returns = pins_alloc(KEY_RETURNS);
+	segdisp_keys_conf_t keys = {returns, PAL_LOW, KEY_DEBOUNCE, &mbox};
+	systime_t frame;
+	systime_t start;
+	systime_t latency;
+	uint32_t events;
+	uint64_t ns;
+	int bounced;
+	int ok;
+	int i;
+
+	for(i = 0; i < KEY_RETURNS; i++){
+		returns->pins[i].port = GPIOC;
+		returns->pins[i].pin = i;
+	}
+	chMBObjectInit(&mbox, buffer, sizeof(buffer) / sizeof(buffer[0]));
+	ok = segdisp_init(disp, disp->segments, disp->digits, SEGDISP_SEGMENTS_SEVEN | SEGDISP_BLANK_SKIPPED) == 0;
+	ok &= segdisp_keys_init(disp, &keys, storage) == 0;
+	host_pal_set_hook(keys_hook);
+	keys_set(0);
+	disp->refresh = 1000;
+	frame = US2ST(disp->refresh) * KEY_DIGITS;
+	segdisp_set_str(disp, text);
+	segdisp_run_timer(disp);
+	host_time_advance(frame * 2);
+	events = disp->keys_event.broadcasts;
+
+	/* key 5 is on the digit 2, it is reported after KEY_DEBOUNCE frames */
+	keys_set(1UL << 5);
+	start = chVTGetSystemTimeX();
+	while(segdisp_key_pressed(disp, 5) != 1 && chVTGetSystemTimeX() - start < frame * 10){
+		host_time_advance(US2ST(disp->refresh));
+	}
+	latency = chVTGetSystemTimeX() - start;
+	ok &= keys_fetch(&mbox) == SEGDISP_KEY_MSG(5, 1) && segdisp_key_pressed(disp, 5) == 1;
+	ok &= latency > frame * (KEY_DEBOUNCE - 1) && latency <= frame * (KEY_DEBOUNCE + 1);
+	ok &= disp->keys_event.broadcasts == events + 1 && (disp->keys_event.flags & SEGDISP_KEYS_PRESSED) != 0;
+
+	/* bouncing shorter than the debounce is not reported */
+	for(i = 0; i < 8; i++){
+		keys_set(i & 1 ? 1UL << 5 : 0);
+		host_time_advance(frame);
+	}
+	keys_set(1UL << 5);
+	host_time_advance(frame * (KEY_DEBOUNCE + 1));
+	bounced = disp->keys_event.broadcasts == events + 1 && keys_fetch(&mbox) == -1;
+	ok &= bounced;
+
+	/* two keys of different digits released and pressed at once */
+	keys_set(1UL << 0 | 1UL << 7);
+	host_time_advance(frame * (KEY_DEBOUNCE + 1));
+	ok &= keys_expect(&mbox, both, 3);
+	ok &= segdisp_key_pressed(disp, 0) == 1 && segdisp_key_pressed(disp, 5) == 0 && segdisp_key_pressed(disp, 7) == 1;
+	keys_set(0);
+	host_time_advance(frame * (KEY_DEBOUNCE + 1));
+	ok &= keys_expect(&mbox, released, 2);
+	ok &= disp->keys_lost == 0 && !disp->idle;
+
+	ns = host_clock_ns();
+	host_time_advance(frame * 10000);
+	ns = host_clock_ns() - ns;
+
+	segdisp_stop(disp);
+	host_pal_set_hook(NULL);
+
+	printf("%-8s %10.1f %10s %10lu %10.1f %8s\n", text, (double) latency / frame, bounced ? "ignored" : "reported",
+		(unsigned long) (disp->keys_event.broadcasts - events), (double) ns / (10000.0 * KEY_DIGITS), ok ? "ok" : "FAIL");
+	return ok;
+}
+
+/* Digits lit in the last multiplex phases recorded by the mock backend, fills their shown codes */
+static uint32_t mock_lit(int number, uint32_t *codes){
+	const host_phase_t *phase;
+	uint32_t lit = 0;
+	int i;
+
+	for(i = 1; i <= number; i++){
+		phase = &host_mock_phases[(host_mock_count - i) % HOST_MOCK_PHASES];
+		if(phase->digit_mask != 0){
+			codes[__builtin_ctz(phase->digit_mask)] = phase->segments;
+			lit |= phase->digit_mask;
+		}
+	}
+	return lit;
+}
+
+/* Plays the animations on a mock backend display and checks the frames at given times */
+static int bench_anim(void){
+	segdisp_t *disp = bench_display_unwired(8, 4, &host_mock_backend);
+	segdisp_anim_frame_t frames[SEGDISP_ANIM_WIPE_FRAMES(4)];
+	uint32_t codes[2 * 4];
+	uint32_t shown[4];
+	uint32_t events;
+	uint32_t lit;
+	systime_t start;
+	int blink;
+	int wipe;
+	int fade;
+	int alternate;
+	int n;
+
+	disp->refresh = 1000;
+	segdisp_set_str(disp, "0123");
+	host_mock_reset();
+	segdisp_run_timer(disp);
+	host_time_advance(MS2ST(8));
+
+	/* two plays of 20 ms on and 20 ms off of the left half */
+	n = segdisp_anim_blink(frames, 0x3, 20, 20);
+	start = chVTGetSystemTimeX();
+	blink = segdisp_anim_play(disp, frames, n, 2) == 0;
+	host_time_advance(MS2ST(10));
+	blink &= mock_lit(4, shown) == 0xF && shown[0] == segdisp_font_7seg['0'];
+	host_time_advance(MS2ST(20));
+	blink &= mock_lit(4, shown) == 0xC && shown[2] == segdisp_font_7seg['2'];
+	host_time_advance(MS2ST(40));
+	blink &= mock_lit(4, shown) == 0xC && disp->anim_event.broadcasts == 0;
+	host_time_advance(start + MS2ST(90) - chVTGetSystemTimeX());
+	blink &= mock_lit(4, shown) == 0xF && disp->anim == NULL && disp->anim_event.broadcasts == 1;
+	printf("%-10s %6d %8lu %8s\n", "blink", n, (unsigned long) disp->anim_event.broadcasts, blink ? "ok" : "FAIL");
+
+	/* 160 ms wipe from 0123 to 4567, the text is set under the animation */
+	n = segdisp_anim_wipe(disp, frames, codes, "4567", 160);
+	start = chVTGetSystemTimeX();
+	wipe = segdisp_anim_play(disp, frames, n, 1) == 0;
+	segdisp_set_str(disp, "4567");
+	host_time_advance(MS2ST(30));
+	lit = mock_lit(4, shown);
+	wipe &= lit == 0xC && shown[3] == segdisp_font_7seg['3'];
+	host_time_advance(MS2ST(80));
+	lit = mock_lit(4, shown);
+	wipe &= lit == 0x3 && shown[0] == segdisp_font_7seg['4'] && shown[1] == segdisp_font_7seg['5'];
+	host_time_advance(start + MS2ST(170) - chVTGetSystemTimeX());
+	lit = mock_lit(4, shown);
+	wipe &= lit == 0xF && shown[3] == segdisp_font_7seg['7'] && disp->anim_event.broadcasts == 2;
+	printf("%-10s %6d %8lu %8s\n", "wipe", n, (unsigned long) disp->anim_event.broadcasts, wipe ? "ok" : "FAIL");
+
+	/* fade out in 4 steps of 10 ms, the brightness planes are used only meanwhile */
+	n = segdisp_anim_fade(frames, 4, SEGDISP_BRIGHTNESS_MAX, 0, 40);
+	start = chVTGetSystemTimeX();
+	fade = segdisp_anim_play(disp, frames, n, 1) == 0;
+	host_time_advance(MS2ST(15));
+	fade &= disp->anim_level == SEGDISP_BRIGHTNESS_MAX * 2 / 3 && disp->steps_number == 4 * SEGDISP_BCM_PLANES;
+	host_time_advance(MS2ST(20));
+	fade &= disp->anim_level == 0 && disp->steps_number == 4 * SEGDISP_BCM_PLANES;
+	host_time_advance(start + MS2ST(50) - chVTGetSystemTimeX());
+	fade &= disp->anim_level == SEGDISP_BRIGHTNESS_MAX && disp->steps_number == 4 && disp->anim_event.broadcasts == 3;
+	printf("%-10s %6d %8lu %8s\n", "fade", n, (unsigned long) disp->anim_event.broadcasts, fade ? "ok" : "FAIL");
+
+	/* two messages alternating every 20 ms until stopped, stopping doesn't broadcast */
+	segdisp_anim_text(disp, &frames[0], &codes[0], "12", 20);
+	segdisp_anim_text(disp, &frames[1], &codes[4], "34", 20);
+	events = disp->anim_event.broadcasts;
+	alternate = segdisp_anim_play(disp, frames, 2, 0) == 0;
+	host_time_advance(MS2ST(10));
+	alternate &= mock_lit(4, shown) == 0xF && shown[0] == segdisp_font_7seg['1'] && shown[2] == segdisp_font_7seg[' '];
+	host_time_advance(MS2ST(100));
+	alternate &= mock_lit(4, shown) == 0xF && shown[0] == segdisp_font_7seg['3'];
+	segdisp_anim_stop(disp);
+	host_time_advance(MS2ST(8));
+	alternate &= mock_lit(4, shown) == 0xF && shown[0] == segdisp_font_7seg['4'] && disp->anim_event.broadcasts == events;
+	printf("%-10s %6d %8lu %8s\n", "alternate", 2, (unsigned long) disp->anim_event.broadcasts, alternate ? "ok" : "FAIL");
+
+	segdisp_stop(disp);
+	return blink && wipe && fade && alternate;
+}
+
+/* Compares the front buffer with the encoded text */
+static int shows(segdisp_t *disp, const char *text){
+	int i;
+
+	for(i = 0; i < disp->digits->number; i++){
+		if(disp->actual[i] != disp->font[(uint8_t) text[i]])
+			return 0;
+	}
+	return 1;
+}
+
+/* Posts from the "interrupt" between timer ticks, several per frame, and checks they coalesce */
+static int bench_mbox(int per_frame){
+	static const bench_conf_t conf = {"7seg x4", 0, 4};
+	segdisp_t *disp = bench_display(&conf);
+	uint32_t *storage = malloc(SEGDISP_MBOX_WORDS(conf.digits) * sizeof(uint32_t));
+	systime_t period;
+	uint64_t spent = 0;
+	uint64_t start;
+	int32_t value = 0;
+	int format;
+	int ok;
+	int f;
+	int p;
+
+	segdisp_mbox_init(disp, storage);
+	segdisp_post_int(disp, -123);
+	segdisp_mbox_apply(disp);
+	format = shows(disp, "-123");
+	segdisp_post_int(disp, 12345);
+	segdisp_mbox_apply(disp);
+	format &= shows(disp, "----");
+	segdisp_post_str(disp, "7");
+	segdisp_mbox_apply(disp);
+	format &= shows(disp, "7   ");
+
+	disp->refresh = 1000;
+	period = US2ST(disp->refresh);
+	segdisp_run_timer(disp);
+	for(f = 0; f < MBOX_FRAMES; f++){
+		for(p = 0; p < per_frame; p++){
+			start = host_clock_ns();
+			segdisp_post_int(disp, value++ % 1000);
+			spent += host_clock_ns() - start;
+			host_time_advance(period * conf.digits / per_frame);
+		}
+	}
+	host_time_advance(period * conf.digits);
+
+	ok = format && disp->mbox_posts == (uint32_t) (MBOX_FRAMES * per_frame + 3) &&
+		disp->mbox_applied <= MBOX_FRAMES + 4 && disp->actual[3] == disp->font['0' + (value - 1) % 10];
+	printf("%10d %8lu %8lu %12.1f %8s\n", per_frame, (unsigned long) disp->mbox_posts, (unsigned long) disp->mbox_applied,
+		(double) spent / (MBOX_FRAMES * per_frame), ok ? "ok" : "FAIL");
+
+	segdisp_stop(disp);
+	free(storage);
+	return ok;
+}
+
+/* Scrolls by the virtual timer, changes speed and step on the fly and checks the shown window */
+static int bench_scroll_timer(const char *name, int refreshed){
+	static const bench_conf_t conf = {"7seg x4", 0, 4};
+	static segdisp_scroll_conf_t scroll = {20, 1};
+	segdisp_t *disp = bench_display(&conf);
+	int first;
+	int second;
+
+	scroll.delay = 20;
+	scroll.step = 1;
+	disp->scroll = &scroll;
+	disp->refresh = 1000;
+	segdisp_set_str(disp, "0123456789");
+	if(refreshed){
+		segdisp_run_timer(disp);
+	}
+	segdisp_scroll_run(disp, NORMALPRIO);
+
+	/* 7 steps by one, the last one is taken at the next frame */
+	host_time_advance(MS2ST(150));
+	first = disp->offset == 7 && shows(disp, "7890");
+	/* 4 steps by two */
+	segdisp_scroll_set(disp, 10, 2);
+	host_time_advance(MS2ST(45));
+	second = disp->offset == 5 && shows(disp, "5678");
+
+	segdisp_scroll_stop(disp);
+	host_time_advance(MS2ST(100));
+	second &= disp->offset == 5;
+
+	printf("%-14s %10s %10s\n", name, first ? "ok" : "FAIL", second ? "ok" : "FAIL");
+	segdisp_stop(disp);
+	return first && second;
+}
+
+static void bench_mapper(const char *name, uint32_t (*mapper)(char c)){
+	uint64_t start = host_clock_ns();
+	uint32_t acc = 0;
+	int i;
+	int c;
+
+	for(i = 0; i < MAPPER_ITERATIONS; i++){
+		for(c = 0; c < 256; c++){
+			acc += mapper((char) c);
+		}
+	}
+	sink = acc;
+
+	printf("%-24s %10.2f\n", name, (double) MAPPER_ITERATIONS * 256 * 1000.0 / (host_clock_ns() - start));
+}
+
+int main(void){
+	unsigned int i;
+	int ok = 1;
+
+	printf("Refresh step\n");
+	printf("%-10s %12s %12s %12s\n", "display", "writes/frame", "toggles/frm", "ns/step");
+	for(i = 0; i < sizeof(confs) / sizeof(confs[0]); i++){
+		bench_refresh(&confs[i]);
+	}
+
+	printf("\nTimer driven refresh (1000 us per digit)\n");
+	printf("%-10s %8s %10s %10s %8s %12s\n", "display", "phases", "min ticks", "max ticks", "spacing", "ns/step");
+	for(i = 0; i < sizeof(confs) / sizeof(confs[0]); i++){
+		ok &= bench_timer(&confs[i]);
+	}
+
+	printf("\nDMA refresh (port word stream)\n");
+	printf("%-10s %11s %8s %10s %10s %12s\n", "display", "words/frame", "stream", "rewritten", "ns/set", "ns/set_str");
+	for(i = 0; i < sizeof(confs) / sizeof(confs[0]); i++){
+		ok &= bench_dma(&confs[i]);
+	}
+
+	printf("\nDirty cells (set_str of an unchanged text, then texts differing in one digit)\n");
+	printf("%-10s %10s %10s %10s %12s\n", "display", "ns/same", "ns/one", "skipped", "cells/update");
+	for(i = 0; i < sizeof(confs) / sizeof(confs[0]); i++){
+		ok &= bench_dirty(&confs[i]);
+	}
+
+	printf("\nBrightness (7seg x4, digit levels 15 8 3 0, lit time / expected in base sub-slots per frame)\n");
+	printf("%7s %6s %6s %6s %10s %10s %10s %10s %6s\n", "refresh", "global", "gamma", "steps", "digit 0", "digit 1", "digit 2", "digit 3",
+		"check");
+	{
+		static const uint8_t gamma[SEGDISP_BRIGHTNESS_MAX + 1] = {0, 1, 1, 1, 1, 2, 2, 3, 4, 5, 6, 7, 9, 10, 12, 15};
+		ok &= bench_brightness(1500, SEGDISP_BRIGHTNESS_MAX, NULL);
+		ok &= bench_brightness(1500, 8, NULL);
+		ok &= bench_brightness(1500, SEGDISP_BRIGHTNESS_MAX, gamma);
+		ok &= bench_brightness(7, SEGDISP_BRIGHTNESS_MAX, NULL);
+	}
+
+	printf("\nDisplay manager (six 7seg x4, 1000 us phase, one thread, lit time / share of the group; dimmed / full display)\n");
+	printf("%-14s %8s %8s %10s %10s %10s %8s\n", "wiring", "displays", "groups", "load %", "writes/s", "lit", "check");
+	ok &= bench_mgr(0);
+	ok &= bench_mgr(1);
+	ok &= bench_mgr_bcm();
+	ok &= bench_mgr_spi();
+	ok &= bench_mgr_stop();
+
+	printf("\nRefresh statistics (7seg x4, thread refresh 1000 us, concurrent writer)\n");
+	bench_stats();
+
+	printf("\nUpdate mailbox (7seg x4, timer refresh 1000 us per digit, %d frames)\n", MBOX_FRAMES);
+	printf("%10s %8s %8s %12s %8s\n", "posts/frm", "posted", "applied", "ns/post", "check");
+	ok &= bench_mbox(1);
+	ok &= bench_mbox(4);
+	ok &= bench_mbox(32);
+
+	printf("\nScroll engine (7seg x4, 20 ms by 1, then 10 ms by 2)\n");
+	printf("%-14s %10s %10s\n", "refresh", "initial", "changed");
+	ok &= bench_scroll_timer("stopped", 0);
+	ok &= bench_scroll_timer("timer 1000 us", 1);
+
+	printf("\nOutput backends (7seg x4)\n");
+	printf("%-8s %14s %14s %10s %8s\n", "backend", "writes/phase", "xfers/phase", "ns/phase", "check");
+	ok &= bench_backends();
+
+	printf("\nMultiplex axis (7seg with DP, phases per frame, average lit digits per phase and digit)\n");
+	printf("%-8s %6s %8s %8s %12s %8s\n", "levels", "digits", "axis", "phases", "duty", "check");
+	ok &= bench_axis(4, SEGDISP_AXIS_AUTO, 0);
+	ok &= bench_axis(16, SEGDISP_AXIS_DIGITS, 0);
+	ok &= bench_axis(16, SEGDISP_AXIS_AUTO, 0);
+	ok &= bench_axis(16, SEGDISP_AXIS_AUTO, 1);
+
+	printf("\nFixed wiring backend (ns per phase)\n");
+	printf("%-10s %12s %12s %8s\n", "display", "generic", "fixed", "check");
+	ok &= bench_fixed(&confs[1], &fixed7_backend);
+	ok &= bench_fixed(&confs[5], &fixed16_backend);
+
+	printf("\nPolarity flags (7seg x2, digit 0 showing 1, segment and digit port levels)\n");
+	printf("%-20s %10s %10s %8s\n", "flags", "segments", "digits", "check");
+	/* segments b and c of 1 are pins 1 and 2, each flag has to change only its own pins */
+	ok &= bench_polarity(0, "none", 0x06, 0b10);
+	ok &= bench_polarity(SEGDISP_INVERTED_SEGMENT, "inverted segment", 0x06, 0b01);
+	ok &= bench_polarity(SEGDISP_INVERTED_DRIVER, "inverted driver", 0xF9, 0b10);
+	ok &= bench_polarity(SEGDISP_INVERTED_SEGMENT | SEGDISP_INVERTED_DRIVER, "both", 0xF9, 0b01);
+
+	printf("\nNumeric rendering (set_fixed compared to snprintf and set_str)\n");
+	printf("%-10s %14s %14s %8s\n", "display", "ns/set_fixed", "ns/snprintf", "check");
+	ok &= bench_numbers();
+
+	printf("\nPin trace (timer refresh 1000 us per digit, 10 frames, perceived frame compared with the font)\n");
+	printf("%-10s %10s %10s %10s %10s %8s\n", "display", "toggles/f", "overlaps/f", "lit min %", "lit max %", "check");
+	ok &= bench_sim("7seg x4", bench_display(&confs[0]), "0123");
+	ok &= bench_sim("7seg 1port", bench_display_at(&confs[0], GPIOB, 0, GPIOB, 8), "4567");
+	ok &= bench_sim("7seg same", bench_display(&confs[0]), "88  ");
+	ok &= bench_sim("16seg x4", bench_display(&confs[4]), "AbCd");
+	ok &= bench_sim("7seg polar", bench_display_polarized(), "5678");
+
+	printf("\nDelta output (7seg x8, timer refresh, per frame: GPIO writes done and avoided, 74HC595 transfers done and skipped)\n");
+	printf("%-10s %10s %10s %10s %10s %8s\n", "text", "writes", "avoided", "transfers", "skipped", "check");
+	ok &= bench_delta("88888888");
+	ok &= bench_delta("      12");
+	ok &= bench_delta("01234567");
+
+	printf("\nBlank digits (7seg x6, timer refresh 1000 us per digit, phases and lit time of 10 frames, writes per dark frame)\n");
+	printf("%-8s %-8s %10s %10s %10s %8s\n", "text", "dark", "phases/f", "lit max %", "dark wr/f", "check");
+	ok &= bench_blank("    12", SEGDISP_BLANK_SHOWN);
+	ok &= bench_blank("    12", SEGDISP_BLANK_SKIPPED);
+	ok &= bench_blank("1  2 3", SEGDISP_BLANK_SKIPPED);
+	ok &= bench_blank("012345", SEGDISP_BLANK_SKIPPED);
+	ok &= bench_blank_thread();
+
+	printf("\nKeys (7seg x4, 2 return lines, timer refresh 1000 us per digit, debounce %d frames)\n", KEY_DEBOUNCE);
+	printf("%-8s %10s %10s %10s %10s %8s\n", "text", "frames", "bouncing", "events", "ns/phase", "check");
+	ok &= bench_keys("1234");
+	ok &= bench_keys("  1 ");
+
+	printf("\nAnimations (7seg x4, timer refresh 1000 us per digit, mock backend)\n");
+	printf("%-10s %6s %8s %8s\n", "animation", "frames", "events", "check");
+	ok &= bench_anim();
+
+	printf("\nInit, run and stop cycles (7seg x4, thread refresh)\n");
+	printf("%-8s %8s %14s %8s\n", "init", "cycles", "allocs/cycle", "check");
+	ok &= bench_lifecycle(0);
+	ok &= bench_lifecycle(1);
+
+	printf("\nScroll step (7seg x8)\n");
+	printf("%8s %6s %14s %14s\n", "length", "step", "ns/scroll", "ns/set_str");
+	bench_scroll(16, 1);
+	bench_scroll(64, 1);
+	bench_scroll(256, 1);
+	bench_scroll(512, 1);
+	bench_scroll(256, 3);
+	bench_scroll(512, 7);
+
+	printf("\nMapper throughput\n");
+	printf("%-24s %10s\n", "mapper", "Mchar/s");
+	bench_mapper("segdisp_7seg_char2int", segdisp_7seg_char2int);
+	bench_mapper("segdisp_16seg_char2ing", segdisp_16seg_char2ing);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,223 @@
+/* ch.h -- host stand-in of the ChibiOS/RT kernel API used by Segdisp
+ *
+ * Copyright (C) 2016 Ondrej Novak
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+/**
+ * @file
+ * @brief Host (Linux) stand-in of the kernel API, threads and mutexes are backed by pthreads
+ */
+
+#ifndef CH_H
+#define CH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+typedef int32_t msg_t;
+
+#define MSG_OK 0
+#define MSG_TIMEOUT -1
+typedef uint32_t tprio_t;
+typedef uint64_t stkalign_t;
+
+#define NORMALPRIO 128
+#define HIGHPRIO 255
+
+/* System time, simulated with 1 us ticks and advanced by host_time_advance */
+
+typedef uint32_t systime_t;
+
+#define CH_CFG_ST_FREQUENCY 1000000
+#define S2ST(sec) ((systime_t)((uint64_t)(sec) * CH_CFG_ST_FREQUENCY))
+#define MS2ST(msec) ((systime_t)(((uint64_t)(msec) * CH_CFG_ST_FREQUENCY + 999) / 1000))
+#define US2ST(usec) ((systime_t)(((uint64_t)(usec) * CH_CFG_ST_FREQUENCY + 999999) / 1000000))
+#define ST2US(n) ((uint32_t)(((uint64_t)(n) * 1000000 + CH_CFG_ST_FREQUENCY - 1) / CH_CFG_ST_FREQUENCY))
+
+/* Realtime counter, nanoseconds of the host monotonic clock */
+
+typedef uint32_t rtcnt_t;
+
+#define HOST_RTC_FREQUENCY 1000000000
+
+rtcnt_t chSysGetRealtimeCounterX(void);
+
+/* Threads */
+
+typedef void (*tfunc_t)(void *p);
+
+#define THD_FUNCTION(tname, arg) void tname(void *arg)
+
+/** Host threads keep their own stack, the working area only holds the thread structure */
+#define THD_WORKING_AREA_SIZE(n) (((sizeof(thread_t) + (size_t)(n)) + sizeof(stkalign_t) - 1) & ~(sizeof(stkalign_t) - 1))
+#define THD_WORKING_AREA(s, n) stkalign_t s[THD_WORKING_AREA_SIZE(n) / sizeof(stkalign_t)]
+
+typedef struct ch_thread {
+	pthread_t tid;
+	tfunc_t func;
+	void *arg;
+	const char *name;
+	volatile bool terminate;
+	bool dynamic;
+	/* suspended on a thread reference, see chThdSuspendS */
+	bool suspended;
+	msg_t rdymsg;
+} thread_t;
+
+typedef thread_t *thread_reference_t;
+
+typedef struct memory_heap memory_heap_t;
+
+thread_t *chThdCreateFromHeap(memory_heap_t *heapp, size_t size, tprio_t prio, tfunc_t pf, void *arg);
+thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio, tfunc_t pf, void *arg);
+void chThdTerminate(thread_t *tp);
+bool chThdShouldTerminateX(void);
+void chThdExit(msg_t msg);
+msg_t chThdWait(thread_t *tp);
+thread_t *chThdGetSelfX(void);
+void chRegSetThreadName(const char *name);
+
+msg_t chThdSuspendS(thread_reference_t *trp);
+void chThdResumeI(thread_reference_t *trp, msg_t msg);
+
+void chThdSleep(systime_t time);
+void chThdSleepMicroseconds(uint32_t usec);
+void chThdSleepMilliseconds(uint32_t msec);
+
+/* Mutexes */
+
+typedef struct ch_mutex {
+	pthread_mutex_t m;
+	/* statistics of the lock, see host_mtx_watch */
+	struct host_mtx_stats *stats;
+	uint64_t locked_at;
+} mutex_t;
+
+void chMtxObjectInit(mutex_t *mp);
+void chMtxLock(mutex_t *mp);
+bool chMtxTryLock(mutex_t *mp);
+void chMtxUnlock(mutex_t *mp);
+
+/* System lock, a single recursive lock standing in for the kernel critical zone */
+
+void chSysLock(void);
+void chSysUnlock(void);
+#define chSysLockFromISR() chSysLock()
+#define chSysUnlockFromISR() chSysUnlock()
+
+typedef int syssts_t;
+
+static inline syssts_t chSysGetStatusAndLockX(void){
+	chSysLock();
+	return 0;
+}
+
+static inline void chSysRestoreStatusX(syssts_t sts){
+	(void) sts;
+	chSysUnlock();
+}
+
+/* Nothing is preempted on the host, the reschedule is a no-op */
+static inline void chSchRescheduleS(void){
+}
+
+/* Event sources, listeners are not modelled, the broadcasts are only counted */
+
+typedef uint32_t eventflags_t;
+
+typedef struct event_source {
+	volatile uint32_t broadcasts;
+	eventflags_t flags;
+} event_source_t;
+
+static inline void chEvtObjectInit(event_source_t *esp){
+	esp->broadcasts = 0;
+	esp->flags = 0;
+}
+
+static inline void chEvtBroadcastFlagsI(event_source_t *esp, eventflags_t flags){
+	esp->broadcasts++;
+	esp->flags |= flags;
+}
+
+#define chEvtBroadcastI(esp) chEvtBroadcastFlagsI(esp, 0)
+
+/* Mailboxes, only the I-class calls used from the system locked state */
+
+typedef int32_t cnt_t;
+
+typedef struct mailbox {
+	msg_t *buffer;
+	cnt_t size;
+	cnt_t rd;
+	cnt_t count;
+} mailbox_t;
+
+static inline void chMBObjectInit(mailbox_t *mbp, msg_t *buf, cnt_t n){
+	mbp->buffer = buf;
+	mbp->size = n;
+	mbp->rd = 0;
+	mbp->count = 0;
+}
+
+static inline msg_t chMBPostI(mailbox_t *mbp, msg_t msg){
+	if(mbp->count == mbp->size){
+		return MSG_TIMEOUT;
+	}
+	mbp->buffer[(mbp->rd + mbp->count++) % mbp->size] = msg;
+	return MSG_OK;
+}
+
+static inline msg_t chMBFetchI(mailbox_t *mbp, msg_t *msgp){
+	if(mbp->count == 0){
+		return MSG_TIMEOUT;
+	}
+	*msgp = mbp->buffer[mbp->rd];
+	mbp->rd = (mbp->rd + 1) % mbp->size;
+	mbp->count--;
+	return MSG_OK;
+}
+
+static inline cnt_t chMBGetUsedCountI(mailbox_t *mbp){
+	return mbp->count;
+}
+
+/* Virtual timers, callbacks are called from host_time_advance */
+
+typedef void (*vtfunc_t)(void *p);
+
+typedef struct ch_virtual_timer {
+	struct ch_virtual_timer *next;
+	systime_t deadline;
+	vtfunc_t func;
+	void *par;
+	bool armed;
+} virtual_timer_t;
+
+systime_t chVTGetSystemTimeX(void);
+void chVTObjectInit(virtual_timer_t *vtp);
+void chVTSetI(virtual_timer_t *vtp, systime_t delay, vtfunc_t vtfunc, void *par);
+void chVTSet(virtual_timer_t *vtp, systime_t delay, vtfunc_t vtfunc, void *par);
+void chVTResetI(virtual_timer_t *vtp);
+void chVTReset(virtual_timer_t *vtp);
+bool chVTIsArmedI(virtual_timer_t *vtp);
+
+/* Memory */
+
+void *chCoreAlloc(size_t size);
+void *chHeapAlloc(memory_heap_t *heapp, size_t size);
+void chHeapFree(void *p);
+
+#endif
@@ -0,0 +1,9 @@
+/* chthreads.h -- host stand-in, everything is declared in ch.h
+ *
+ * Copyright (C) 2016 Ondrej Novak
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "ch.h"
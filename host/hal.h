@@ -0,0 +1,125 @@
+/* hal.h -- host stand-in of the ChibiOS/HAL PAL driver used by Segdisp
+ *
+ * Copyright (C) 2016 Ondrej Novak
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+/**
+ * @file
+ * @brief Host (Linux) stand-in of the PAL driver, every port write is recorded
+ */
+
+#ifndef HAL_H
+#define HAL_H
+
+#include "ch.h"
+
+typedef uint32_t ioportmask_t;
+typedef uint32_t iomode_t;
+
+/**
+ * Simulated GPIO port
+ */
+typedef struct host_port {
+	/** Port name used in reports */
+	const char *name;
+	/** Output levels */
+	volatile ioportmask_t odr;
+	/** Input levels */
+	volatile ioportmask_t idr;
+	/** Mode of every pad */
+	iomode_t mode[32];
+} host_port_t;
+
+typedef host_port_t *ioportid_t;
+
+#define HOST_PORTS_NUMBER 9
+
+extern host_port_t host_ports[HOST_PORTS_NUMBER];
+
+#define GPIOA (&host_ports[0])
+#define GPIOB (&host_ports[1])
+#define GPIOC (&host_ports[2])
+#define GPIOD (&host_ports[3])
+#define GPIOE (&host_ports[4])
+#define GPIOF (&host_ports[5])
+#define GPIOG (&host_ports[6])
+#define GPIOH (&host_ports[7])
+#define GPIOI (&host_ports[8])
+
+#define PAL_MODE_RESET 0
+#define PAL_MODE_INPUT 1
+#define PAL_MODE_INPUT_PULLUP 2
+#define PAL_MODE_INPUT_PULLDOWN 3
+#define PAL_MODE_OUTPUT_PUSHPULL 4
+#define PAL_MODE_OUTPUT_OPENDRAIN 5
+
+#define PAL_LOW 0
+#define PAL_HIGH 1
+
+#define PAL_PORT_BIT(n) ((ioportmask_t)1U << (n))
+#define PAL_GROUP_MASK(width) ((ioportmask_t)(1U << (width)) - 1U)
+
+/** Writes the pins selected by mask, a single recorded port write */
+void host_pal_write(ioportid_t port, ioportmask_t mask, ioportmask_t bits);
+
+#define palSetPadMode(port, pad, m) ((port)->mode[(pad)] = (m))
+#define palReadPort(port) ((port)->idr)
+#define palReadLatch(port) ((port)->odr)
+#define palReadPad(port, pad) (((port)->idr >> (pad)) & 1U)
+#define palWritePort(port, bits) host_pal_write((port), 0xFFFFFFFFU, (bits))
+#define palSetPort(port, bits) host_pal_write((port), (bits), 0xFFFFFFFFU)
+#define palClearPort(port, bits) host_pal_write((port), (bits), 0U)
+#define palWriteGroup(port, mask, offset, bits) host_pal_write((port), (ioportmask_t)(mask) << (offset), (ioportmask_t)(bits) << (offset))
+#define palSetPad(port, pad) palSetPort((port), PAL_PORT_BIT(pad))
+#define palClearPad(port, pad) palClearPort((port), PAL_PORT_BIT(pad))
+#define palWritePad(port, pad, bit) host_pal_write((port), PAL_PORT_BIT(pad), (ioportmask_t)(bit) << (pad))
+
+/* SPI driver, a transfer completes at once or after delay ticks and the slave select line latches the shifted bits like a 74HC595 chain */
+
+#define HAL_USE_SPI TRUE
+
+typedef enum {
+	SPI_UNINIT = 0,
+	SPI_STOP = 1,
+	SPI_READY = 2,
+	SPI_ACTIVE = 3,
+	SPI_COMPLETE = 4
+} spistate_t;
+
+typedef struct host_spi SPIDriver;
+
+typedef void (*spicallback_t)(SPIDriver *spip);
+
+typedef struct {
+	spicallback_t end_cb;
+} SPIConfig;
+
+/**
+ * Simulated SPI driver with a shift register chain
+ */
+struct host_spi {
+	volatile spistate_t state;
+	const SPIConfig *config;
+	/** Bits shifted to the chain */
+	uint64_t shift;
+	/** Bits latched to the outputs of the chain */
+	uint64_t latched;
+	/** Number of transfers */
+	unsigned long transfers;
+	/** Ticks a transfer stays active, 0 completes it at once (set after spiStart) */
+	systime_t delay;
+	/** Timer completing the active transfer */
+	virtual_timer_t timer;
+};
+
+extern SPIDriver SPID1;
+
+void spiStart(SPIDriver *spip, const SPIConfig *config);
+void spiStartSendI(SPIDriver *spip, size_t n, const void *txbuf);
+#define spiSelectI(spip) ((void) (spip))
+void spiUnselectI(SPIDriver *spip);
+
+#endif
@@ -0,0 +1,564 @@
+/* host.c -- Segdisp host stand-in of ChibiOS
+ *
+ * Copyright (C) 2016 Ondrej Novak
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+/**
+ * @file
+ * @brief Host (Linux) implementation of the kernel and PAL stand-ins
+ */
+
+#include "ch.h"
+#include "hal.h"
+#include "host.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+host_port_t host_ports[HOST_PORTS_NUMBER] = {
+	{ .name = "GPIOA" }, { .name = "GPIOB" }, { .name = "GPIOC" },
+	{ .name = "GPIOD" }, { .name = "GPIOE" }, { .name = "GPIOF" },
+	{ .name = "GPIOG" }, { .name = "GPIOH" }, { .name = "GPIOI" }
+};
+
+volatile unsigned long host_pal_writes;
+volatile unsigned long host_pal_toggles;
+volatile unsigned long host_allocs;
+volatile long host_heap_blocks;
+
+static host_pal_hook_t pal_hook;
+static pthread_mutex_t sys_lock;
+static pthread_once_t sys_lock_once = PTHREAD_ONCE_INIT;
+static pthread_cond_t sys_resume = PTHREAD_COND_INITIALIZER;
+static __thread thread_t *current;
+static volatile systime_t now;
+static virtual_timer_t *timers;
+
+/* PAL */
+
+void host_pal_write(ioportid_t port, ioportmask_t mask, ioportmask_t bits){
+	ioportmask_t before = port->odr;
+	ioportmask_t after = (before & ~mask) | (bits & mask);
+
+	port->odr = after;
+	host_pal_writes++;
+	host_pal_toggles += __builtin_popcount(before ^ after);
+	if(pal_hook != NULL){
+		pal_hook(port, before, after);
+	}
+}
+
+void host_pal_reset(void){
+	host_pal_writes = 0;
+	host_pal_toggles = 0;
+}
+
+void host_pal_set_hook(host_pal_hook_t hook){
+	pal_hook = hook;
+}
+
+uint64_t host_clock_ns(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+rtcnt_t chSysGetRealtimeCounterX(void){
+	return (rtcnt_t) host_clock_ns();
+}
+
+/* System lock */
+
+static void sys_lock_init(void){
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&sys_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+void chSysLock(void){
+	pthread_once(&sys_lock_once, sys_lock_init);
+	pthread_mutex_lock(&sys_lock);
+}
+
+void chSysUnlock(void){
+	pthread_mutex_unlock(&sys_lock);
+}
+
+/* Threads */
+
+static void *thread_entry(void *arg){
+	thread_t *tp = arg;
+
+	current = tp;
+	tp->func(tp->arg);
+	return NULL;
+}
+
+static thread_t *thread_start(thread_t *tp, tfunc_t pf, void *arg){
+	tp->func = pf;
+	tp->arg = arg;
+	tp->name = NULL;
+	tp->terminate = false;
+	tp->suspended = false;
+	if(pthread_create(&tp->tid, NULL, thread_entry, tp) != 0){
+		return NULL;
+	}
+	return tp;
+}
+
+thread_t *chThdCreateFromHeap(memory_heap_t *heapp, size_t size, tprio_t prio, tfunc_t pf, void *arg){
+	thread_t *tp;
+
+	(void) heapp;
+	(void) size;
+	(void) prio;
+	host_allocs++;
+	tp = malloc(sizeof(thread_t));
+	if(tp == NULL){
+		return NULL;
+	}
+	tp->dynamic = true;
+	if(thread_start(tp, pf, arg) == NULL){
+		free(tp);
+		return NULL;
+	}
+	return tp;
+}
+
+thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio, tfunc_t pf, void *arg){
+	thread_t *tp = wsp;
+
+	(void) prio;
+	if(size < sizeof(thread_t)){
+		return NULL;
+	}
+	tp->dynamic = false;
+	return thread_start(tp, pf, arg);
+}
+
+void chThdTerminate(thread_t *tp){
+	tp->terminate = true;
+}
+
+bool chThdShouldTerminateX(void){
+	return current != NULL && current->terminate;
+}
+
+void chThdExit(msg_t msg){
+	pthread_exit((void *) (intptr_t) msg);
+}
+
+msg_t chThdWait(thread_t *tp){
+	void *ret;
+
+	pthread_join(tp->tid, &ret);
+	if(tp->dynamic){
+		free(tp);
+	}
+	return (msg_t) (intptr_t) ret;
+}
+
+thread_t *chThdGetSelfX(void){
+	return current;
+}
+
+void chRegSetThreadName(const char *name){
+	if(current != NULL){
+		current->name = name;
+	}
+}
+
+/* Has to be called with the system lock held once */
+msg_t chThdSuspendS(thread_reference_t *trp){
+	*trp = current;
+	current->suspended = true;
+	while(current->suspended){
+		pthread_cond_wait(&sys_resume, &sys_lock);
+	}
+	return current->rdymsg;
+}
+
+void chThdResumeI(thread_reference_t *trp, msg_t msg){
+	thread_t *tp = *trp;
+
+	if(tp == NULL){
+		return;
+	}
+	*trp = NULL;
+	tp->rdymsg = msg;
+	tp->suspended = false;
+	pthread_cond_broadcast(&sys_resume);
+}
+
+void chThdSleep(systime_t time){
+	chThdSleepMicroseconds(ST2US(time));
+}
+
+void chThdSleepMicroseconds(uint32_t usec){
+	struct timespec ts = { usec / 1000000, (usec % 1000000) * 1000 };
+
+	while(nanosleep(&ts, &ts) != 0){
+	}
+}
+
+void chThdSleepMilliseconds(uint32_t msec){
+	chThdSleepMicroseconds(msec * 1000);
+}
+
+/* Mutexes */
+
+void chMtxObjectInit(mutex_t *mp){
+	pthread_mutex_init(&mp->m, NULL);
+	mp->stats = NULL;
+}
+
+static void mtx_record(unsigned long *histogram, uint64_t *max, uint64_t ns){
+	int i;
+
+	for(i = 0; i < HOST_MTX_BUCKETS - 1 && ns >= (1000ULL << (2 * i)); i++){
+	}
+	histogram[i]++;
+	if(ns > *max){
+		*max = ns;
+	}
+}
+
+/* the statistics are updated by the owner of the mutex only */
+void chMtxLock(mutex_t *mp){
+	host_mtx_stats_t *st = mp->stats;
+	uint64_t start;
+
+	if(st == NULL){
+		pthread_mutex_lock(&mp->m);
+		return;
+	}
+	start = host_clock_ns();
+	if(pthread_mutex_trylock(&mp->m) != 0){
+		pthread_mutex_lock(&mp->m);
+		st->contended++;
+	}
+	mp->locked_at = host_clock_ns();
+	st->locks++;
+	mtx_record(st->wait, &st->wait_max, mp->locked_at - start);
+}
+
+bool chMtxTryLock(mutex_t *mp){
+	if(pthread_mutex_trylock(&mp->m) != 0){
+		return false;
+	}
+	if(mp->stats != NULL){
+		mp->locked_at = host_clock_ns();
+		mp->stats->locks++;
+		mtx_record(mp->stats->wait, &mp->stats->wait_max, 0);
+	}
+	return true;
+}
+
+void chMtxUnlock(mutex_t *mp){
+	if(mp->stats != NULL){
+		mtx_record(mp->stats->hold, &mp->stats->hold_max, host_clock_ns() - mp->locked_at);
+	}
+	pthread_mutex_unlock(&mp->m);
+}
+
+/**
+ * Starts collecting wait and hold times of a mutex, call it while nobody uses the mutex
+ * @param mp    Mutex
+ * @param stats Statistics to fill, NULL stops the collection
+ */
+void host_mtx_watch(mutex_t *mp, host_mtx_stats_t *stats){
+	if(stats != NULL){
+		memset(stats, 0, sizeof(*stats));
+	}
+	mp->stats = stats;
+}
+
+/* Virtual timers */
+
+systime_t chVTGetSystemTimeX(void){
+	return now;
+}
+
+void chVTObjectInit(virtual_timer_t *vtp){
+	vtp->armed = false;
+	vtp->next = NULL;
+}
+
+void chVTResetI(virtual_timer_t *vtp){
+	virtual_timer_t **pp;
+
+	if(!vtp->armed){
+		return;
+	}
+	for(pp = &timers; *pp != vtp; pp = &(*pp)->next){
+	}
+	*pp = vtp->next;
+	vtp->armed = false;
+}
+
+void chVTReset(virtual_timer_t *vtp){
+	chSysLock();
+	chVTResetI(vtp);
+	chSysUnlock();
+}
+
+void chVTSetI(virtual_timer_t *vtp, systime_t delay, vtfunc_t vtfunc, void *par){
+	virtual_timer_t **pp;
+
+	chVTResetI(vtp);
+	vtp->deadline = now + delay;
+	vtp->func = vtfunc;
+	vtp->par = par;
+	vtp->armed = true;
+
+	/* timers are kept sorted, equal deadlines fire in the order they were set */
+	for(pp = &timers; *pp != NULL && (systime_t) ((*pp)->deadline - now) <= delay; pp = &(*pp)->next){
+	}
+	vtp->next = *pp;
+	*pp = vtp;
+}
+
+void chVTSet(virtual_timer_t *vtp, systime_t delay, vtfunc_t vtfunc, void *par){
+	chSysLock();
+	chVTSetI(vtp, delay, vtfunc, par);
+	chSysUnlock();
+}
+
+bool chVTIsArmedI(virtual_timer_t *vtp){
+	return vtp->armed;
+}
+
+/**
+ * Advances the simulated system time and fires the expired virtual timers in order
+ * @param ticks Number of ticks to advance
+ */
+void host_time_advance(systime_t ticks){
+	systime_t end = now + ticks;
+	virtual_timer_t *vtp;
+
+	chSysLock();
+	while(timers != NULL && (systime_t) (timers->deadline - now) <= (systime_t) (end - now)){
+		vtp = timers;
+		timers = vtp->next;
+		vtp->armed = false;
+		now = vtp->deadline;
+		/* callbacks take the lock by themselves, like in an ISR */
+		chSysUnlock();
+		vtp->func(vtp->par);
+		chSysLock();
+	}
+	now = end;
+	chSysUnlock();
+}
+
+static pthread_t systick_thread;
+static volatile bool systick_running;
+
+/* Advances the simulated time along with the real time */
+static void *systick_entry(void *arg){
+	uint64_t start = host_clock_ns();
+	systime_t base = now;
+	systime_t target;
+
+	(void) arg;
+	while(systick_running){
+		chThdSleepMicroseconds(100);
+		target = base + (systime_t) ((host_clock_ns() - start) / (1000000000ULL / CH_CFG_ST_FREQUENCY));
+		host_time_advance(target - now);
+	}
+	return NULL;
+}
+
+/**
+ * Starts advancing the simulated system time in real time, virtual timers then fire on their own
+ */
+void host_systick_start(void){
+	if(systick_running){
+		return;
+	}
+	systick_running = true;
+	pthread_create(&systick_thread, NULL, systick_entry, NULL);
+}
+
+/**
+ * Stops advancing the simulated system time in real time
+ */
+void host_systick_stop(void){
+	if(!systick_running){
+		return;
+	}
+	systick_running = false;
+	pthread_join(systick_thread, NULL);
+}
+
+/* DMA */
+
+#define HOST_DMA_STREAMS SEGDISP_MAX_PORTS
+
+/**
+ * One circular stream of port words
+ */
+typedef struct host_dma_stream {
+	ioportid_t port;
+	const uint32_t *words;
+	int count;
+	int next;
+} host_dma_stream_t;
+
+static host_dma_stream_t dma_streams[HOST_DMA_STREAMS];
+static virtual_timer_t dma_timer;
+static systime_t dma_period;
+volatile unsigned long host_dma_words;
+
+/* Timer trigger, writes the next word of every stream like a BSRR write */
+static void dma_trigger(void *arg){
+	host_dma_stream_t *st;
+	uint32_t word;
+	int i;
+
+	(void) arg;
+	chSysLockFromISR();
+	chVTSetI(&dma_timer, dma_period, dma_trigger, NULL);
+	chSysUnlockFromISR();
+
+	for(i = 0; i < HOST_DMA_STREAMS; i++){
+		st = &dma_streams[i];
+		if(st->words == NULL){
+			continue;
+		}
+		word = st->words[st->next];
+		host_pal_write(st->port, (word | (word >> 16)) & 0xFFFF, word & 0xFFFF);
+		host_dma_words++;
+		if(++st->next == st->count){
+			st->next = 0;
+		}
+	}
+}
+
+static int dma_start(void *ctx, int index, ioportid_t port, const uint32_t *words, int count, int period){
+	(void) ctx;
+	if(index >= HOST_DMA_STREAMS){
+		return -1;
+	}
+
+	chSysLock();
+	dma_streams[index].port = port;
+	dma_streams[index].words = words;
+	dma_streams[index].count = count;
+	dma_streams[index].next = 0;
+	if(!chVTIsArmedI(&dma_timer)){
+		dma_period = US2ST(period);
+		chVTSetI(&dma_timer, dma_period, dma_trigger, NULL);
+	}
+	chSysUnlock();
+	return 0;
+}
+
+static void dma_stop(void *ctx){
+	int i;
+
+	(void) ctx;
+	chSysLock();
+	chVTResetI(&dma_timer);
+	for(i = 0; i < HOST_DMA_STREAMS; i++){
+		dma_streams[i].words = NULL;
+	}
+	chSysUnlock();
+}
+
+const segdisp_dma_backend_t host_dma_backend = {dma_start, dma_stop, NULL};
+
+/* SPI */
+
+SPIDriver SPID1;
+
+void spiStart(SPIDriver *spip, const SPIConfig *config){
+	chSysLock();
+	chVTResetI(&spip->timer);
+	chSysUnlock();
+	spip->config = config;
+	spip->shift = 0;
+	spip->latched = 0;
+	spip->transfers = 0;
+	spip->delay = 0;
+	spip->state = SPI_READY;
+}
+
+/* End of the transfer, runs the end callback of the configuration like the SPI interrupt */
+static void spi_end(void *arg){
+	SPIDriver *spip = arg;
+
+	spip->state = SPI_COMPLETE;
+	if(spip->config->end_cb != NULL){
+		spip->config->end_cb(spip);
+	}
+	spip->state = SPI_READY;
+}
+
+void spiStartSendI(SPIDriver *spip, size_t n, const void *txbuf){
+	const uint8_t *tx = txbuf;
+	size_t i;
+
+	spip->state = SPI_ACTIVE;
+	for(i = 0; i < n; i++){
+		spip->shift = (spip->shift << 8) | tx[i];
+	}
+	spip->transfers++;
+	if(spip->delay != 0){
+		chVTSetI(&spip->timer, spip->delay, spi_end, spip);
+		return;
+	}
+	spi_end(spip);
+}
+
+void spiUnselectI(SPIDriver *spip){
+	spip->latched = spip->shift;
+}
+
+/* Mock output backend */
+
+host_phase_t host_mock_phases[HOST_MOCK_PHASES];
+volatile unsigned long host_mock_count;
+
+static void mock_phase(void *ctx, segdisp_t *disp, uint32_t digit_mask, uint32_t segments){
+	host_phase_t *phase = &host_mock_phases[host_mock_count % HOST_MOCK_PHASES];
+
+	(void) ctx;
+	(void) disp;
+	phase->time = chVTGetSystemTimeX();
+	phase->digit_mask = digit_mask;
+	phase->segments = segments;
+	host_mock_count++;
+}
+
+void host_mock_reset(void){
+	host_mock_count = 0;
+}
+
+const segdisp_backend_t host_mock_backend = {mock_phase, NULL, NULL, NULL};
+
+/* Memory */
+
+void *chCoreAlloc(size_t size){
+	host_allocs++;
+	return malloc(size);
+}
+
+void *chHeapAlloc(memory_heap_t *heapp, size_t size){
+	(void) heapp;
+	host_allocs++;
+	host_heap_blocks++;
+	return malloc(size);
+}
+
+void chHeapFree(void *p){
+	host_heap_blocks--;
+	free(p);
+}
@@ -0,0 +1,99 @@
+/* host.h -- control interface of the Segdisp host stand-in
+ *
+ * Copyright (C) 2016 Ondrej Novak
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+/**
+ * @file
+ * @brief Inspection of the simulated hardware, used by the host programs only
+ */
+
+#ifndef HOST_H
+#define HOST_H
+
+#include "hal.h"
+#include "segdisp.h"
+
+/** Number of port writes since the last host_pal_reset */
+extern volatile unsigned long host_pal_writes;
+/** Number of pin level changes since the last host_pal_reset */
+extern volatile unsigned long host_pal_toggles;
+
+/**
+ * Hook called after every port write
+ * @param port   Written port
+ * @param before Levels before the write
+ * @param after  Levels after the write
+ */
+typedef void (*host_pal_hook_t)(ioportid_t port, ioportmask_t before, ioportmask_t after);
+
+void host_pal_reset(void);
+void host_pal_set_hook(host_pal_hook_t hook);
+
+uint64_t host_clock_ns(void);
+
+void host_time_advance(systime_t ticks);
+void host_systick_start(void);
+void host_systick_stop(void);
+
+/** Number of buckets of the mutex histograms, bucket i counts times below 4^i us, the last one the rest */
+#define HOST_MTX_BUCKETS 8
+
+/**
+ * Statistics of a watched mutex, times are in host ns
+ */
+typedef struct host_mtx_stats {
+	/** Number of acquisitions */
+	unsigned long locks;
+	/** Number of acquisitions that had to wait */
+	unsigned long contended;
+	/** Histogram of the wait times */
+	unsigned long wait[HOST_MTX_BUCKETS];
+	/** Histogram of the hold times */
+	unsigned long hold[HOST_MTX_BUCKETS];
+	/** Longest wait */
+	uint64_t wait_max;
+	/** Longest hold */
+	uint64_t hold_max;
+} host_mtx_stats_t;
+
+void host_mtx_watch(mutex_t *mp, host_mtx_stats_t *stats);
+
+/** Number of core, heap and thread allocations */
+extern volatile unsigned long host_allocs;
+/** Number of blocks taken from the heap by chHeapAlloc and not freed yet */
+extern volatile long host_heap_blocks;
+
+/** DMA backend stand-in, every period it writes the next word of each stream to its port */
+extern const segdisp_dma_backend_t host_dma_backend;
+/** Number of port words written by the DMA stand-in */
+extern volatile unsigned long host_dma_words;
+
+/** Number of phases kept by the mock backend */
+#define HOST_MOCK_PHASES 256
+
+/**
+ * Phase recorded by the mock backend
+ */
+typedef struct host_phase {
+	/** System time of the phase */
+	systime_t time;
+	/** Enabled digits */
+	uint32_t digit_mask;
+	/** Output value of the segments */
+	uint32_t segments;
+} host_phase_t;
+
+/** Output backend recording the phases in memory instead of driving pins */
+extern const segdisp_backend_t host_mock_backend;
+/** Last HOST_MOCK_PHASES phases, phase n is at index n % HOST_MOCK_PHASES */
+extern host_phase_t host_mock_phases[HOST_MOCK_PHASES];
+/** Number of phases since the last host_mock_reset */
+extern volatile unsigned long host_mock_count;
+
+void host_mock_reset(void);
+
+#endif
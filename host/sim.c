@@ -0,0 +1,412 @@
+/* sim.c -- pin-level simulator of a Segdisp display on the host
+ *
+ * Copyright (C) 2016 Ondrej Novak
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+/**
+ * @file
+ * @brief Trace of the segment and digit pins of one display, VCD export, perceived frame and metrics
+ */
+
+#include <string.h>
+#include "host.h"
+#include "sim.h"
+
+/* simulator receiving the port writes, the PAL hook is global */
+static host_sim_t *active;
+
+/* Decodes the lines from the port levels */
+static uint32_t sim_decode(const host_sim_line_t *lines, int number){
+	uint32_t state = 0;
+	int i;
+
+	for(i = 0; i < number; i++){
+		if(((lines[i].port->odr ^ lines[i].idle) & lines[i].mask) != 0){
+			state |= 1UL << i;
+		}
+	}
+	return state;
+}
+
+static void sim_record(host_sim_t *sim, uint8_t kind, uint8_t frame){
+	host_sim_event_t *ev;
+
+	if(sim->count == sim->capacity){
+		sim->dropped++;
+		return;
+	}
+	ev = &sim->events[sim->count++];
+	ev->time = chVTGetSystemTimeX();
+	ev->ns = host_clock_ns();
+	ev->segments = sim->state_segments;
+	ev->digits = sim->state_digits;
+	ev->kind = kind;
+	ev->frame = frame;
+}
+
+static void sim_hook(ioportid_t port, ioportmask_t before, ioportmask_t after){
+	host_sim_t *sim = active;
+	int i;
+
+	(void) before;
+	(void) after;
+	if(sim == NULL)
+		return;
+	for(i = 0; i < sim->disp->ports_number && sim->disp->ports[i].port != port; i++)
+		;
+	if(i == sim->disp->ports_number)
+		return;
+
+	sim->state_segments = sim_decode(sim->segments, sim->disp->segments->number);
+	sim->state_digits = sim_decode(sim->digits, sim->disp->digits->number);
+	sim_record(sim, HOST_SIM_WRITE, 0);
+}
+
+/* Backend wrapper marking the end of every phase */
+static void sim_phase(void *ctx, segdisp_t *disp, uint32_t digit_mask, uint32_t segments){
+	host_sim_t *sim = ctx;
+
+	sim->target->phase(sim->target->ctx, disp, digit_mask, segments);
+	sim_record(sim, HOST_SIM_PHASE, disp->step == disp->step_first);
+}
+
+/* Backend wrapper passing the invalidation to the wrapped backend */
+static void sim_invalidate(void *ctx){
+	host_sim_t *sim = ctx;
+
+	if(sim->target->invalidate != NULL){
+		sim->target->invalidate(sim->target->ctx);
+	}
+}
+
+static void sim_line(host_sim_line_t *line, const segdisp_t *disp, const segdisp_pin_plan_t *plan, int idle){
+	line->port = disp->ports[plan->port].port;
+	line->mask = PAL_PORT_BIT(plan->pin);
+	line->idle = idle ? line->mask : 0;
+}
+
+/**
+ * Attaches the simulator to a display driving GPIO pins, it replaces the display backend by a wrapper
+ * @param  sim      Simulator
+ * @param  disp     Display, its refresh has to be stopped
+ * @param  events   Trace storage
+ * @param  capacity Number of events of the storage
+ * @return          Returns -1 on failure, 0 on success
+ */
+int host_sim_attach(host_sim_t *sim, segdisp_t *disp, host_sim_event_t *events, unsigned long capacity){
+	/* the level of a segment that is off depends on the wiring only, unlike the idle level of the plan,
+	 * which a polarized font moves into the font table (the segments are then off at seg_invert) */
+	int seg_idle = (disp->flags & SEGDISP_DRIVER_FLAG) == SEGDISP_INVERTED_DRIVER;
+	int dig_idle = (disp->flags & SEGDISP_COMMON_ELECTRODE_FLAG) != SEGDISP_INVERTED_SEGMENT;
+	int i;
+
+	if(active != NULL || disp->ports_number == 0 || events == NULL || capacity == 0)
+		return -1;
+
+	memset(sim, 0, sizeof(*sim));
+	sim->disp = disp;
+	sim->events = events;
+	sim->capacity = capacity;
+	for(i = 0; i < disp->segments->number; i++){
+		sim_line(&sim->segments[i], disp, &disp->seg_plan[i], seg_idle);
+	}
+	for(i = 0; i < disp->digits->number; i++){
+		sim_line(&sim->digits[i], disp, &disp->dig_plan[i], dig_idle);
+	}
+	sim->state_segments = sim_decode(sim->segments, disp->segments->number);
+	sim->state_digits = sim_decode(sim->digits, disp->digits->number);
+
+	sim->target = disp->backend;
+	sim->backend.phase = sim_phase;
+	sim->backend.invalidate = sim_invalidate;
+	sim->backend.ctx = sim;
+	sim->backend.bus = sim->target->bus;
+	if(segdisp_set_backend(disp, &sim->backend) != 0)
+		return -1;
+
+	active = sim;
+	host_pal_set_hook(sim_hook);
+	return 0;
+}
+
+/**
+ * Detaches the simulator, the display gets its backend back
+ * @param sim Simulator, the refresh of its display has to be stopped
+ */
+void host_sim_detach(host_sim_t *sim){
+	host_pal_set_hook(NULL);
+	active = NULL;
+	segdisp_set_backend(sim->disp, sim->target);
+}
+
+/**
+ * Drops the recorded trace
+ * @param sim Simulator
+ */
+void host_sim_clear(host_sim_t *sim){
+	sim->count = 0;
+	sim->dropped = 0;
+}
+
+/* Part of the duration of event i inside the window */
+static systime_t sim_duration(const host_sim_t *sim, unsigned long i, systime_t from, systime_t to){
+	systime_t start = sim->events[i].time;
+	systime_t end = i + 1 < sim->count ? sim->events[i + 1].time : to;
+
+	if((int32_t) (start - from) < 0)
+		start = from;
+	if((int32_t) (end - to) > 0)
+		end = to;
+	return (int32_t) (end - start) > 0 ? end - start : 0;
+}
+
+/* Time every digit was enabled, enabled with some segment driven and every segment of it driven in the window */
+static void sim_lit_times(const host_sim_t *sim, systime_t from, systime_t to, systime_t *enabled, systime_t *on,
+	systime_t (*lit)[SEGDISP_MAX_SEGMENTS]){
+	const host_sim_event_t *ev;
+	systime_t d;
+	uint32_t digits;
+	uint32_t segments;
+	unsigned long i;
+
+	memset(enabled, 0, SEGDISP_MAX_DIGITS * sizeof(*enabled));
+	memset(on, 0, SEGDISP_MAX_DIGITS * sizeof(*on));
+	memset(lit, 0, SEGDISP_MAX_DIGITS * sizeof(*lit));
+	for(i = 0; i < sim->count; i++){
+		ev = &sim->events[i];
+		d = sim_duration(sim, i, from, to);
+		if(d == 0)
+			continue;
+		for(digits = ev->digits; digits != 0; digits &= digits - 1){
+			enabled[__builtin_ctz(digits)] += d;
+			if(ev->segments != 0){
+				on[__builtin_ctz(digits)] += d;
+			}
+			for(segments = ev->segments; segments != 0; segments &= segments - 1){
+				lit[__builtin_ctz(digits)][__builtin_ctz(segments)] += d;
+			}
+		}
+	}
+}
+
+/**
+ * Computes the metrics of the trace in a time window
+ * @param sim     Simulator
+ * @param from    Start of the window
+ * @param to      End of the window
+ * @param metrics Metrics to fill
+ */
+void host_sim_metrics(const host_sim_t *sim, systime_t from, systime_t to, host_sim_metrics_t *metrics){
+	static systime_t lit[SEGDISP_MAX_DIGITS][SEGDISP_MAX_SEGMENTS];
+	systime_t enabled[SEGDISP_MAX_DIGITS];
+	const host_sim_event_t *ev;
+	const host_sim_event_t *prev = NULL;
+	const host_sim_event_t *final = NULL;
+	unsigned long first = 0;
+	unsigned long i;
+	unsigned long k;
+	int d;
+	int s;
+
+	memset(metrics, 0, sizeof(*metrics));
+	for(i = 0; i < sim->count; i++){
+		ev = &sim->events[i];
+		if((int32_t) (ev->time - from) < 0 || (int32_t) (ev->time - to) >= 0){
+			first = i + 1;
+			continue;
+		}
+		if(prev != NULL){
+			metrics->toggles += __builtin_popcount(ev->segments ^ prev->segments) + __builtin_popcount(ev->digits ^ prev->digits);
+		}
+		prev = ev;
+		if(ev->kind != HOST_SIM_PHASE)
+			continue;
+
+		metrics->phases++;
+		metrics->frames += ev->frame;
+		/* writes of the phase that showed neither the previous nor the new phase */
+		for(k = first; final != NULL && k < i; k++){
+			if(sim->events[k].digits == 0)
+				continue;
+			if((sim->events[k].segments == final->segments && sim->events[k].digits == final->digits) ||
+				(sim->events[k].segments == ev->segments && sim->events[k].digits == ev->digits))
+				continue;
+			metrics->overlaps++;
+			metrics->overlap_ns += sim->events[k + 1].ns - sim->events[k].ns;
+		}
+		final = ev;
+		first = i + 1;
+	}
+
+	sim_lit_times(sim, from, to, enabled, metrics->lit, lit);
+	for(d = 0; d < sim->disp->digits->number; d++){
+		for(s = 0; s < sim->disp->segments->number; s++){
+			if(lit[d][s] != 0 && 2 * lit[d][s] < enabled[d]){
+				metrics->ghosts++;
+			}
+		}
+	}
+}
+
+/**
+ * Reconstructs the perceived output values, a segment is seen when it's driven at least half of the time its digit is enabled
+ * @param sim   Simulator
+ * @param from  Start of the window
+ * @param to    End of the window
+ * @param codes Output values of the digits, segment i is bit i
+ */
+void host_sim_glyphs(const host_sim_t *sim, systime_t from, systime_t to, uint32_t *codes){
+	static systime_t lit[SEGDISP_MAX_DIGITS][SEGDISP_MAX_SEGMENTS];
+	systime_t enabled[SEGDISP_MAX_DIGITS];
+	systime_t on[SEGDISP_MAX_DIGITS];
+	int d;
+	int s;
+
+	sim_lit_times(sim, from, to, enabled, on, lit);
+	for(d = 0; d < sim->disp->digits->number; d++){
+		codes[d] = 0;
+		for(s = 0; s < sim->disp->segments->number; s++){
+			if(lit[d][s] != 0 && 2 * lit[d][s] >= enabled[d]){
+				codes[d] |= 1UL << s;
+			}
+		}
+	}
+}
+
+/* Cells of the 7 segment glyph, 3 rows of 4 columns, segment bit of every cell or -1 */
+static const int8_t glyph7[3][4] = {
+	{-1, 0, -1, -1},
+	{5, 6, 1, -1},
+	{4, 3, 2, 7},
+};
+static const char glyph7_chars[3][4] = {
+	" _  ",
+	"|_| ",
+	"|_|.",
+};
+
+/* Cells of the 16 segment glyph, 5 rows of 6 columns */
+static const int8_t glyph16[5][6] = {
+	{-1, 0, -1, 1, -1, -1},
+	{7, 10, 11, 12, 2, -1},
+	{-1, 8, -1, 9, -1, -1},
+	{6, 15, 14, 13, 3, -1},
+	{-1, 4, -1, 5, -1, 16},
+};
+static const char glyph16_chars[5][6] = {
+	" - - ",
+	"|\\|/|",
+	" - - ",
+	"|/|\\|",
+	" - - .",
+};
+
+/**
+ * Renders the perceived frame as ASCII art, rows ended by newlines
+ * @param  sim  Simulator
+ * @param  from Start of the window
+ * @param  to   End of the window
+ * @param  out  Output string
+ * @param  size Size of the output
+ * @return      Returns -1 if the output is too small, 0 on success
+ */
+int host_sim_render(const host_sim_t *sim, systime_t from, systime_t to, char *out, size_t size){
+	uint32_t codes[SEGDISP_MAX_DIGITS];
+	int sixteen = (sim->disp->flags & SEGDISP_SEGMENTS_FLAG) == SEGDISP_SEGMENTS_SIXTEEN;
+	int rows = sixteen ? 5 : 3;
+	int cols = sixteen ? 6 : 4;
+	int digits = sim->disp->digits->number;
+	int cell;
+	int r;
+	int d;
+	int c;
+
+	if(size < (size_t) (rows * (digits * cols + 1) + 1))
+		return -1;
+
+	host_sim_glyphs(sim, from, to, codes);
+	for(r = 0; r < rows; r++){
+		for(d = 0; d < digits; d++){
+			for(c = 0; c < cols; c++){
+				cell = sixteen ? glyph16[r][c] : glyph7[r][c];
+				*out++ = cell >= 0 && ((codes[d] >> cell) & 1) ? (sixteen ? glyph16_chars[r][c] : glyph7_chars[r][c]) : ' ';
+			}
+		}
+		*out++ = '\n';
+	}
+	*out = '\0';
+	return 0;
+}
+
+/* VCD identifier of the line */
+static void sim_vcd_id(char *id, int line){
+	id[0] = '!' + line % 94;
+	id[1] = line >= 94 ? '!' + line / 94 : '\0';
+	id[2] = '\0';
+}
+
+static void sim_vcd_changes(FILE *f, uint32_t changed, uint32_t state, int base){
+	char id[3];
+
+	for(; changed != 0; changed &= changed - 1){
+		sim_vcd_id(id, base + __builtin_ctz(changed));
+		fprintf(f, "%d%s\n", (int) ((state >> __builtin_ctz(changed)) & 1), id);
+	}
+}
+
+/**
+ * Writes the trace as a value change dump, the writes within one tick are spread 1 ns apart
+ * @param  sim Simulator
+ * @param  f   Output file
+ * @return     Returns -1 on failure, 0 on success
+ */
+int host_sim_vcd(const host_sim_t *sim, FILE *f){
+	int segments = sim->disp->segments->number;
+	int digits = sim->disp->digits->number;
+	const host_sim_event_t *ev;
+	uint32_t seg_state;
+	uint32_t dig_state;
+	uint64_t last = 0;
+	uint64_t t;
+	char id[3];
+	unsigned long i;
+	int k;
+
+	if(sim->count == 0)
+		return -1;
+
+	fprintf(f, "$timescale 1ns $end\n$scope module segdisp $end\n");
+	for(k = 0; k < segments + digits; k++){
+		sim_vcd_id(id, k);
+		if(k < segments)
+			fprintf(f, "$var wire 1 %s seg%d $end\n", id, k);
+		else
+			fprintf(f, "$var wire 1 %s dig%d $end\n", id, k - segments);
+	}
+	fprintf(f, "$upscope $end\n$enddefinitions $end\n#0\n$dumpvars\n");
+	seg_state = sim->events[0].segments;
+	dig_state = sim->events[0].digits;
+	sim_vcd_changes(f, segments < 32 ? (1UL << segments) - 1 : 0xFFFFFFFF, seg_state, 0);
+	sim_vcd_changes(f, digits < 32 ? (1UL << digits) - 1 : 0xFFFFFFFF, dig_state, segments);
+	fprintf(f, "$end\n");
+
+	for(i = 1; i < sim->count; i++){
+		ev = &sim->events[i];
+		if(ev->segments == seg_state && ev->digits == dig_state)
+			continue;
+		t = (uint64_t) (systime_t) (ev->time - sim->events[0].time) * 1000000000 / CH_CFG_ST_FREQUENCY;
+		if(t <= last)
+			t = last + 1;
+		fprintf(f, "#%llu\n", (unsigned long long) t);
+		sim_vcd_changes(f, ev->segments ^ seg_state, ev->segments, 0);
+		sim_vcd_changes(f, ev->digits ^ dig_state, ev->digits, segments);
+		seg_state = ev->segments;
+		dig_state = ev->digits;
+		last = t;
+	}
+
+	return ferror(f) ? -1 : 0;
+}
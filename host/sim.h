@@ -0,0 +1,112 @@
+/* sim.h -- pin-level simulator of a Segdisp display on the host
+ *
+ * Copyright (C) 2016 Ondrej Novak
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+/**
+ * @file
+ * @brief Trace of the segment and digit pins of one display, VCD export, perceived frame and metrics
+ */
+
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+#include <stdio.h>
+#include "hal.h"
+#include "segdisp.h"
+
+/** Trace event of a port write inside a multiplex phase */
+#define HOST_SIM_WRITE 0
+/** Trace event of the end of a multiplex phase, the state the phase meant to show */
+#define HOST_SIM_PHASE 1
+
+/**
+ * Trace event, state of the display lines after it
+ */
+typedef struct host_sim_event {
+	/** System time of the event */
+	systime_t time;
+	/** Host clock of the event in ns, orders the writes done within one tick */
+	uint64_t ns;
+	/** Segment lines driven on, bit i is the segment i */
+	uint32_t segments;
+	/** Digit lines enabled, bit i is the digit i */
+	uint32_t digits;
+	/** HOST_SIM_WRITE or HOST_SIM_PHASE */
+	uint8_t kind;
+	/** The phase is the first one of a frame */
+	uint8_t frame;
+} host_sim_event_t;
+
+/**
+ * Line of the display watched by the simulator
+ */
+typedef struct host_sim_line {
+	/** Port of the pin */
+	ioportid_t port;
+	/** Mask of the pin */
+	ioportmask_t mask;
+	/** Level of the pin when the line is off */
+	ioportmask_t idle;
+} host_sim_line_t;
+
+/**
+ * Simulator attached to one display
+ */
+typedef struct host_sim {
+	/** Traced display */
+	segdisp_t *disp;
+	/** Backend of the display wrapped by the simulator */
+	const segdisp_backend_t *target;
+	/** Backend marking the phases, set to the display */
+	segdisp_backend_t backend;
+	/** Segment lines */
+	host_sim_line_t segments[SEGDISP_MAX_SEGMENTS];
+	/** Digit lines */
+	host_sim_line_t digits[SEGDISP_MAX_DIGITS];
+	/** Trace storage */
+	host_sim_event_t *events;
+	/** Capacity of the storage */
+	unsigned long capacity;
+	/** Number of recorded events */
+	unsigned long count;
+	/** Number of events not recorded because the storage was full */
+	unsigned long dropped;
+	/** Current state of the segment lines */
+	uint32_t state_segments;
+	/** Current state of the digit lines */
+	uint32_t state_digits;
+} host_sim_t;
+
+/**
+ * Metrics of a trace window
+ */
+typedef struct host_sim_metrics {
+	/** Frames started in the window */
+	unsigned long frames;
+	/** Phases done in the window */
+	unsigned long phases;
+	/** Transitions of the segment and digit lines */
+	unsigned long toggles;
+	/** Intermediate states of phase changes that drove an enabled digit by segment data of neither phase */
+	unsigned long overlaps;
+	/** Host time spent in the overlaps (ns) */
+	uint64_t overlap_ns;
+	/** Time each digit was enabled with some segment driven (system ticks) */
+	systime_t lit[SEGDISP_MAX_DIGITS];
+	/** Segments driven for less than half of the time their digit was enabled (ghosts) */
+	unsigned long ghosts;
+} host_sim_metrics_t;
+
+int host_sim_attach(host_sim_t *sim, segdisp_t *disp, host_sim_event_t *events, unsigned long capacity);
+void host_sim_detach(host_sim_t *sim);
+void host_sim_clear(host_sim_t *sim);
+void host_sim_metrics(const host_sim_t *sim, systime_t from, systime_t to, host_sim_metrics_t *metrics);
+void host_sim_glyphs(const host_sim_t *sim, systime_t from, systime_t to, uint32_t *codes);
+int host_sim_render(const host_sim_t *sim, systime_t from, systime_t to, char *out, size_t size);
+int host_sim_vcd(const host_sim_t *sim, FILE *f);
+
+#endif
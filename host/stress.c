@@ -0,0 +1,282 @@
+/* stress.c -- Segdisp concurrency stress benchmark on the host stand-in
+ *
+ * Copyright (C) 2016 Ondrej Novak
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+/**
+ * @file
+ * @brief Writer threads calling set_str, set and move_cont against the running refresh and scroll
+ *
+ * Usage: stress [writers] [ms]
+ * Without arguments it runs with 1, 2, 4 and 8 writers. The writers show texts of one repeated character,
+ * scroll them and overwrite single digits by '-', so every frame has to show at most one character
+ * besides '-' and blanks, other frames are torn. A probe thread sets texts of a character nobody
+ * else uses and the refresh measures when it shows them. It exits with nonzero status on a torn frame.
+ */
+
+#include "ch.h"
+#include "hal.h"
+#include "host.h"
+#include "segdisp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DIGITS 8
+#define REFRESH 100
+#define RUN_MS 400
+#define MAX_WRITERS 8
+#define WRITER_PAUSE_US 100
+#define PROBES 4096
+#define PROBE_TIMEOUT_MS 5
+
+static segdisp_t disp;
+static segdisp_scroll_conf_t scroll = {5, 1};
+static host_mtx_stats_t display_stats;
+static host_mtx_stats_t string_stats;
+static volatile bool stop;
+static volatile unsigned long ops;
+
+/* frame checking, done by the refresh thread */
+static uint32_t frame_codes[DIGITS];
+static uint32_t frame_digits;
+static unsigned long frames;
+static unsigned long torn;
+
+/* probe */
+static volatile uint32_t probe_code;
+static volatile uint64_t probe_start;
+static volatile uint64_t probe_seen;
+static volatile bool probe_armed;
+static uint64_t latencies[PROBES];
+static int probes;
+static unsigned long probes_lost;
+
+/* A frame may show one character besides '-' and blank digits */
+static void frame_check(void){
+	uint32_t text = 0;
+	int i;
+
+	if(frame_digits != (1UL << DIGITS) - 1)
+		return;
+	frames++;
+	for(i = 0; i < DIGITS; i++){
+		if(frame_codes[i] == disp.font[' '] || frame_codes[i] == disp.font['-'])
+			continue;
+		if(text != 0 && frame_codes[i] != text){
+			torn++;
+			return;
+		}
+		text = frame_codes[i];
+	}
+}
+
+/* Backend wrapper watching the shown phases */
+static void stress_phase(void *ctx, segdisp_t *d, uint32_t digit_mask, uint32_t segments){
+	(void) ctx;
+	segdisp_gpio_backend.phase(segdisp_gpio_backend.ctx, d, digit_mask, segments);
+
+	if(d->step == d->step_first){
+		frame_check();
+		frame_digits = 0;
+	}
+	if(digit_mask == 0)
+		return;
+	frame_codes[__builtin_ctz(digit_mask)] = segments;
+	frame_digits |= digit_mask;
+	if(probe_armed && segments == probe_code){
+		probe_seen = host_clock_ns();
+		probe_armed = false;
+	}
+}
+
+static const segdisp_backend_t stress_backend = {stress_phase, NULL, NULL, NULL};
+
+static uint32_t xorshift(uint32_t *state){
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+static THD_FUNCTION(writer, arg) {
+	uint32_t rng = 0x9E3779B9u * (uint32_t) (uintptr_t) arg + 1;
+	char text[DIGITS + 1];
+	uint32_t r;
+
+	memset(text, '0' + (int) (uintptr_t) arg, DIGITS);
+	text[DIGITS] = '\0';
+	while(!stop){
+		r = xorshift(&rng);
+		switch(r % 8){
+		case 0:
+			segdisp_set_str(&disp, text);
+			break;
+		case 1:
+		case 2:
+		case 3:
+		case 4:
+		case 5:
+			segdisp_move_cont(&disp, 1 + (r >> 8) % 3);
+			break;
+		default:
+			segdisp_set(&disp, (r >> 8) % DIGITS, '-');
+			break;
+		}
+		__sync_fetch_and_add(&ops, 1);
+		chThdSleepMicroseconds((r >> 16) % WRITER_PAUSE_US);
+	}
+}
+
+/* Sets texts of '8' and '9' and waits until the refresh shows them */
+static THD_FUNCTION(probe, arg) {
+	char text[DIGITS + 1];
+	char marker = '8';
+	uint64_t deadline;
+
+	(void) arg;
+	text[DIGITS] = '\0';
+	while(!stop){
+		memset(text, marker, DIGITS);
+		probe_code = disp.font[(uint8_t) marker];
+		probe_start = host_clock_ns();
+		probe_armed = true;
+		segdisp_set_str(&disp, text);
+		deadline = probe_start + PROBE_TIMEOUT_MS * 1000000ULL;
+		while(probe_armed && host_clock_ns() < deadline){
+			chThdSleepMicroseconds(50);
+		}
+		if(probe_armed){
+			/* overwritten by a writer before the next frame */
+			probe_armed = false;
+			probes_lost++;
+		}
+		else if(probes < PROBES){
+			latencies[probes++] = probe_seen - probe_start;
+		}
+		marker = marker == '8' ? '9' : '8';
+		chThdSleepMicroseconds(1000);
+	}
+}
+
+static int compare(const void *a, const void *b){
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double percentile(int p){
+	return probes != 0 ? latencies[(probes - 1) * p / 100] / 1000.0 : 0.0;
+}
+
+static void print_histogram(const char *name, int writers, const host_mtx_stats_t *st){
+	int i;
+
+	printf("%-8s %3d %8lu %8lu  wait", name, writers, st->locks, st->contended);
+	for(i = 0; i < HOST_MTX_BUCKETS; i++){
+		printf(" %6lu", st->wait[i]);
+	}
+	printf(" %8.1f\n%-8s %3s %8s %8s  hold", st->wait_max / 1000.0, "", "", "", "");
+	for(i = 0; i < HOST_MTX_BUCKETS; i++){
+		printf(" %6lu", st->hold[i]);
+	}
+	printf(" %8.1f\n", st->hold_max / 1000.0);
+}
+
+static int run(int writers, int ms){
+	thread_t *threads[MAX_WRITERS + 1];
+	int i;
+
+	stop = false;
+	ops = 0;
+	frames = 0;
+	torn = 0;
+	frame_digits = 0;
+	probes = 0;
+	probes_lost = 0;
+	host_mtx_watch(disp.display_buffer_mtx, &display_stats);
+	host_mtx_watch(disp.string_buffer_mtx, &string_stats);
+
+	segdisp_set_str(&disp, "00000000");
+	segdisp_run(&disp, NORMALPRIO);
+	segdisp_scroll_run(&disp, NORMALPRIO);
+	for(i = 0; i < writers; i++){
+		threads[i] = chThdCreateFromHeap(NULL, THD_WORKING_AREA_SIZE(256), NORMALPRIO, writer, (void *) (uintptr_t) i);
+	}
+	threads[writers] = chThdCreateFromHeap(NULL, THD_WORKING_AREA_SIZE(256), NORMALPRIO, probe, NULL);
+	chThdSleepMilliseconds(ms);
+	stop = true;
+	for(i = 0; i <= writers; i++){
+		chThdWait(threads[i]);
+	}
+	segdisp_scroll_stop(&disp);
+	segdisp_stop(&disp);
+	host_mtx_watch(disp.display_buffer_mtx, NULL);
+	host_mtx_watch(disp.string_buffer_mtx, NULL);
+
+	qsort(latencies, probes, sizeof(latencies[0]), compare);
+	printf("%7d %8lu %8lu %6lu %8d %6lu %8.1f %8.1f %8.1f %8.1f\n", writers, ops, frames, torn, probes, probes_lost,
+		percentile(50), percentile(90), percentile(99), percentile(100));
+	return torn == 0;
+}
+
+int main(int argc, char **argv){
+	static const int counts[] = {1, 2, 4, 8};
+	host_mtx_stats_t display_all[4];
+	host_mtx_stats_t string_all[4];
+	segdisp_pins_t *segments = calloc(1, sizeof(segdisp_pins_t) + 8 * sizeof(segdisp_pin_def_t));
+	segdisp_pins_t *digits = calloc(1, sizeof(segdisp_pins_t) + DIGITS * sizeof(segdisp_pin_def_t));
+	int writers = argc > 1 ? atoi(argv[1]) : 0;
+	int ms = argc > 2 ? atoi(argv[2]) : RUN_MS;
+	int runs = writers > 0 ? 1 : 4;
+	int ok = 1;
+	int i;
+
+	if(writers > MAX_WRITERS || ms <= 0){
+		fprintf(stderr, "usage: stress [writers (1..%d)] [ms]\n", MAX_WRITERS);
+		return 2;
+	}
+	segments->number = 8;
+	for(i = 0; i < 8; i++){
+		segments->pins[i].port = GPIOA;
+		segments->pins[i].pin = i;
+	}
+	digits->number = DIGITS;
+	for(i = 0; i < DIGITS; i++){
+		digits->pins[i].port = GPIOD;
+		digits->pins[i].pin = i;
+	}
+	if(segdisp_init(&disp, segments, digits, SEGDISP_SEGMENTS_SEVEN) != 0 ||
+		segdisp_set_backend(&disp, &stress_backend) != 0){
+		fprintf(stderr, "stress: init failed\n");
+		return 1;
+	}
+	disp.refresh = REFRESH;
+	disp.scroll = &scroll;
+
+	host_systick_start();
+	printf("Stress (7seg x%d, thread refresh %d us, scroll %d ms, %d ms per run)\n", DIGITS, REFRESH, scroll.delay, ms);
+	printf("%7s %8s %8s %6s %8s %6s %8s %8s %8s %8s\n", "writers", "ops", "frames", "torn", "probes", "lost",
+		"p50 us", "p90 us", "p99 us", "max us");
+	for(i = 0; i < runs; i++){
+		ok &= run(writers > 0 ? writers : counts[i], ms);
+		display_all[i] = display_stats;
+		string_all[i] = string_stats;
+	}
+	host_systick_stop();
+
+	printf("\nMutex wait and hold times (counts below 1, 4, 16, 64, 256, 1024, 4096 us and above, max us)\n");
+	printf("%-8s %3s %8s %8s\n", "mutex", "wr", "locks", "waited");
+	for(i = 0; i < runs; i++){
+		print_histogram("display", writers > 0 ? writers : counts[i], &display_all[i]);
+	}
+	for(i = 0; i < runs; i++){
+		print_histogram("string", writers > 0 ? writers : counts[i], &string_all[i]);
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+/* trace.c -- pin trace of a Segdisp display on the host stand-in
+ *
+ * Copyright (C) 2016 Ondrej Novak
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+/**
+ * @file
+ * @brief Runs the timer refresh of a display, prints the perceived frame and the metrics and writes a VCD file
+ *
+ * Usage: trace [-16] [text] [file.vcd]
+ * The 7 segment display has segments on GPIOA 0..7 and digits on GPIOD 0..3,
+ * the 16 segment one has segments on GPIOE 0..16 and digits on GPIOD 0..3.
+ */
+
+#include "ch.h"
+#include "hal.h"
+#include "host.h"
+#include "sim.h"
+#include "segdisp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DIGITS 4
+#define REFRESH 1000
+#define FRAMES 10
+#define EVENTS 4096
+
+static host_sim_event_t events[EVENTS];
+
+int main(int argc, char **argv){
+	static segdisp_t disp;
+	static host_sim_t sim;
+	host_sim_metrics_t m;
+	segdisp_pins_t *segments;
+	segdisp_pins_t *digits;
+	const char *text = "0123";
+	const char *vcd = NULL;
+	char frame[512];
+	systime_t start;
+	systime_t end;
+	int sixteen = 0;
+	int i;
+	FILE *f;
+
+	for(i = 1; i < argc; i++){
+		if(strcmp(argv[i], "-16") == 0)
+			sixteen = 1;
+		else if(strstr(argv[i], ".vcd") != NULL)
+			vcd = argv[i];
+		else
+			text = argv[i];
+	}
+
+	segments = calloc(1, sizeof(segdisp_pins_t) + 17 * sizeof(segdisp_pin_def_t));
+	digits = calloc(1, sizeof(segdisp_pins_t) + DIGITS * sizeof(segdisp_pin_def_t));
+	segments->number = sixteen ? 17 : 8;
+	for(i = 0; i < segments->number; i++){
+		segments->pins[i].port = sixteen ? GPIOE : GPIOA;
+		segments->pins[i].pin = i;
+	}
+	digits->number = DIGITS;
+	for(i = 0; i < DIGITS; i++){
+		digits->pins[i].port = GPIOD;
+		digits->pins[i].pin = i;
+	}
+	if(segdisp_init(&disp, segments, digits, sixteen ? SEGDISP_SEGMENTS_SIXTEEN : SEGDISP_SEGMENTS_SEVEN) != 0 ||
+		host_sim_attach(&sim, &disp, events, EVENTS) != 0){
+		fprintf(stderr, "trace: init failed\n");
+		return 1;
+	}
+
+	disp.refresh = REFRESH;
+	segdisp_set_str(&disp, text);
+	segdisp_run_timer(&disp);
+	/* the trace starts with the second frame */
+	host_time_advance(US2ST(REFRESH) * DIGITS);
+	host_sim_clear(&sim);
+	start = chVTGetSystemTimeX();
+	host_time_advance(US2ST(REFRESH) * DIGITS * FRAMES);
+	end = chVTGetSystemTimeX();
+	segdisp_stop(&disp);
+
+	host_sim_render(&sim, start, end, frame, sizeof(frame));
+	host_sim_metrics(&sim, start, end, &m);
+	fputs(frame, stdout);
+	printf("frames %lu, phases %lu, toggles/frame %.1f, overlaps/frame %.1f (%.0f ns each), ghosts %lu, dropped %lu\n",
+		m.frames, m.phases, m.frames != 0 ? (double) m.toggles / m.frames : 0.0,
+		m.frames != 0 ? (double) m.overlaps / m.frames : 0.0, m.overlaps != 0 ? (double) m.overlap_ns / m.overlaps : 0.0,
+		m.ghosts, sim.dropped);
+	for(i = 0; i < DIGITS; i++){
+		printf("digit %d lit %5.1f %%\n", i, 100.0 * m.lit[i] / (end - start));
+	}
+
+	if(vcd != NULL){
+		f = fopen(vcd, "w");
+		if(f == NULL || host_sim_vcd(&sim, f) != 0){
+			fprintf(stderr, "trace: can't write %s\n", vcd);
+			return 1;
+		}
+		fclose(f);
+	}
+	host_sim_detach(&sim);
+	return 0;
+}
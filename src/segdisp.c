@@ -19,6 +19,16 @@
 #include "chthreads.h"
 #include "util.h"
 
+static void segdisp_fb_swap_i(segdisp_t *disp);
+static void segdisp_frame_i(segdisp_t *disp);
+static int segdisp_scroll_apply_i(segdisp_t *disp);
+static void segdisp_anim_step_i(segdisp_t *disp);
+static void segdisp_keys_sample_i(segdisp_t *disp);
+static void segdisp_dma_update_i(segdisp_t *disp);
+static inline void segdisp_show_step(segdisp_t *disp, const segdisp_step_t *step);
+static void segdisp_msg_lock(segdisp_t *disp);
+static void segdisp_msg_unlock(segdisp_t *disp);
+
 /* Threads */
 
 /* This thread periodically runs and refresesh all the digits */
@@ -27,652 +37,2482 @@ static THD_FUNCTION(segdisp_refresh_thread, arg) {
   chRegSetThreadName("segdisp_refresh");
 
   while (true) {
-  	int i;
-  	for(i = 0; i < disp->digits->number; i++){
-  		chMtxLock(disp->display_buffer_mtx);
-    	segdisp_show_digit(disp, i, disp->actual[i]);
-    	chMtxUnlock(disp->display_buffer_mtx);
-		chThdSleepMicroseconds(disp->refresh);
+  	systime_t ticks = segdisp_refresh_step(disp);
+
+  	if(ticks != 0){
+  		chThdSleep(ticks);
+  	}
+  	else{
+  		/* dark display, nothing to refresh until the next update */
+  		chSysLock();
+  		if(disp->idle && !chThdShouldTerminateX()){
+  			chThdSuspendS(&disp->idle_thread);
+  		}
+  		chSysUnlock();
   	}
 
-  	if(chThdShouldTerminateX()){
+  	if(disp->step == 0 && chThdShouldTerminateX()){
+  		segdisp_blank(disp);
   		chThdExit((msg_t) 0);
   	}
   }
 }
 
-/* Thread for text scrolling */
-static THD_FUNCTION(segdisp_scroll_thread, arg) {
-  segdisp_t *disp = (segdisp_t*)arg;
-  chRegSetThreadName("segdisp_scroll");
+/**
+ * Adds one pin to the output plan [internal]
+ * @param  disp Display configuration structure
+ * @param  def  Pin definition
+ * @param  plan Plan entry to fill
+ * @param  idle Level of the pin when the segment is off or the digit is disabled
+ * @return      Returns -1 on failure, 0 on success
+ */
+static int segdisp_plan_pin(segdisp_t *disp, const segdisp_pin_def_t *def, segdisp_pin_plan_t *plan, int idle){
+	int i;
 
-  while (true) {
-	chThdSleepMilliseconds(disp->scroll->delay);
+	for(i = 0; i < disp->ports_number; i++){
+		if(disp->ports[i].port == (ioportid_t) def->port)
+			break;
+	}
 
-  	if(chThdShouldTerminateX()){
-  		chThdExit((msg_t) 0);
-  	}
-  	
-  	segdisp_move_cont(disp, disp->scroll->step);
-  }
+	if(i == disp->ports_number){
+		if(disp->ports_number == SEGDISP_MAX_PORTS)
+			return -1;
+		disp->ports[i].port = (ioportid_t) def->port;
+		disp->ports[i].mask = 0;
+		disp->ports[i].idle = 0;
+		disp->ports_number++;
+	}
+
+	plan->port = i;
+	plan->pin = def->pin;
+	disp->ports[i].mask |= PAL_PORT_BIT(def->pin);
+	if(idle){
+		disp->ports[i].idle |= PAL_PORT_BIT(def->pin);
+	}
+
+	return 0;
 }
 
 /**
- * @brief Initializes the Display configuration structure [external API]
- * @param disp     Pointer to allocated segdisp_t structure
- * @param segments Pointer to allocated and configured segdisp_pins_t structure defining the segments of one digit
- * @param digits   Pointer to allocated and configured segdisp_pins_t structure defining the digits
- * @param flags    Configuring flags
- * rReturn		   Returns -1 on failure, 0 on success.
+ * Checks that all the pins are GPIO pins [internal]
+ * @param  pins Pins structure
+ * @return      Returns 1 if none of the pins has NULL port, 0 otherwise
  */
-int segdisp_init(segdisp_t *disp, segdisp_pins_t *segments, segdisp_pins_t *digits, uint8_t flags){
+static int segdisp_pins_wired(const segdisp_pins_t *pins){
 	int i;
 
-	disp->segments = segments;
-	disp->digits = digits;
-
-	disp->flags = flags;
-	disp->actual = chCoreAlloc(digits->number * sizeof(typeof(disp->actual)));
-	if(disp->actual == NULL){
-		return -1;
+	for(i = 0; i < pins->number; i++){
+		if(pins->pins[i].port == NULL)
+			return 0;
 	}
+	return 1;
+}
 
-	disp->buffer = NULL;
-	disp->buffer_strlen = 0;
-	disp->offset = 0;
+/**
+ * Turns the pin tables into the per-port output plan and resolves the polarity [internal]
+ * @param  disp Display configuration structure
+ * @return      Returns -1 on failure, 0 on success
+ */
+static int segdisp_plan_build(segdisp_t *disp){
+	int seg_idle = !disp->font_polarized && (disp->flags & SEGDISP_DRIVER_FLAG) == SEGDISP_INVERTED_DRIVER;
+	int dig_idle = (disp->flags & SEGDISP_COMMON_ELECTRODE_FLAG) != SEGDISP_INVERTED_SEGMENT;
+	int i;
 
-	disp->display_buffer_mtx = chCoreAlloc(sizeof(mutex_t));
-	disp->string_buffer_mtx = chCoreAlloc(sizeof(mutex_t));
+	disp->ports_number = 0;
+	disp->out_valid = false;
 
-	if(disp->display_buffer_mtx == NULL){
-		return -1;
+	if(disp->segments->number == SEGDISP_MAX_SEGMENTS){
+		disp->seg_mask = 0xFFFFFFFF;
 	}
-
-	if(disp->string_buffer_mtx == NULL){
-		return -1;
+	else{
+		disp->seg_mask = (1UL << disp->segments->number) - 1;
 	}
 
-	disp->refresh = 5000;
+	disp->seg_invert = disp->font_polarized && (disp->flags & SEGDISP_DRIVER_FLAG) == SEGDISP_INVERTED_DRIVER ? disp->seg_mask : 0;
 
-	for(i = 0; i < disp->segments->number; i++){
-		palSetPadMode((ioportid_t) disp->segments->pins[i].port, disp->segments->pins[i].pin, PAL_MODE_OUTPUT_PUSHPULL);
-	}
+	/* display without GPIO pins, only the numbers of the pins are used by its backend */
+	if(!segdisp_pins_wired(disp->digits) || !segdisp_pins_wired(disp->segments))
+		return 0;
 
+	/* digits go first, so they are switched before the segments */
 	for(i = 0; i < disp->digits->number; i++){
-		palSetPadMode((ioportid_t) disp->digits->pins[i].port, disp->digits->pins[i].pin, PAL_MODE_OUTPUT_PUSHPULL);
+		if(segdisp_plan_pin(disp, &disp->digits->pins[i], &disp->dig_plan[i], dig_idle) != 0)
+			return -1;
 	}
 
-	chMtxObjectInit(disp->display_buffer_mtx);
-	chMtxObjectInit(disp->string_buffer_mtx);
+	for(i = 0; i < disp->segments->number; i++){
+		if(segdisp_plan_pin(disp, &disp->segments->pins[i], &disp->seg_plan[i], seg_idle) != 0)
+			return -1;
+	}
 
-	return 0 ;
+	return 0;
 }
 
 /**
- * Set output value for specific segment (one segment enable) [internal]
- * @param disp Display configuration structure
- * @param seg  Segment number
- * @param out  Output value
+ * Duration of a step, steps of the lit lines are stretched over the dark ones [internal]
+ * @param  disp Display configuration structure
+ * @param  step Step
+ * @return      Duration in system ticks
  */
-void segdisp_seg_out(segdisp_t *disp, int seg, int out){
-	if((disp->flags & SEGDISP_DRIVER_FLAG) == SEGDISP_INVERTED_DRIVER){
-		if(out){
-			palClearPad((ioportid_t) disp->segments->pins[seg].port, disp->segments->pins[seg].pin);
-		}
-		else{
-			palSetPad((ioportid_t) disp->segments->pins[seg].port, disp->segments->pins[seg].pin);
-		}
-	}
-	else{
-		if(out){
-			palSetPad((ioportid_t) disp->segments->pins[seg].port, disp->segments->pins[seg].pin);
-		}
-		else{
-			palClearPad((ioportid_t) disp->segments->pins[seg].port, disp->segments->pins[seg].pin);
-		}
-	}
+static inline systime_t segdisp_step_ticks(segdisp_t *disp, const segdisp_step_t *step){
+	if(disp->dark == 0)
+		return step->ticks;
+
+	return step->ticks * disp->lines / disp->lines_lit;
 }
 
 /**
- * Set output value for specific digit (common electrode enable) [internal]
- * @param disp  Display configuration structure
- * @param digit Digit number
- * @param out   Output value
+ * Moves to the next step of a line that is not dark, to the step 0 at the end of the frame [internal]
+ * @param disp Display configuration structure
  */
-void segdisp_dig_ena(segdisp_t *disp, int digit, int out){
-
-	if((disp->flags & SEGDISP_COMMON_ELECTRODE_FLAG) == SEGDISP_INVERTED_SEGMENT){
-		if(out){
-			palSetPad((ioportid_t) disp->digits->pins[digit].port, disp->digits->pins[digit].pin);
-		}
-		else{
-			palClearPad((ioportid_t) disp->digits->pins[digit].port, disp->digits->pins[digit].pin);
+static inline void segdisp_step_next(segdisp_t *disp){
+	do{
+		if(++disp->step >= disp->steps_number){
+			disp->step = 0;
+			return;
 		}
+	} while((disp->dark >> disp->steps[disp->step].digit) & 1);
+}
+
+/* Timer callback advancing the multiplex by one step, runs in ISR context */
+static void segdisp_timer_cb(void *arg){
+	segdisp_t *disp = (segdisp_t*)arg;
+	const segdisp_step_t *step;
+
+	chSysLockFromISR();
+	if(disp->refresh_mode != SEGDISP_REFRESH_TIMER){
+		chSysUnlockFromISR();
+		return;
 	}
-	else{
-		if(out){
-			palClearPad((ioportid_t) disp->digits->pins[digit].port, disp->digits->pins[digit].pin);
-		}
-		else{
-			palSetPad((ioportid_t) disp->digits->pins[digit].port, disp->digits->pins[digit].pin);
+	/* new content is taken only at the frame boundary */
+	if(disp->step == 0){
+		segdisp_frame_i(disp);
+		if(disp->idle){
+			/* dark display, the next update sets the timer again */
+			chSysUnlockFromISR();
+			segdisp_blank(disp);
+			return;
 		}
 	}
+	step = &disp->steps[disp->step];
+	/* keys of the previous digit are read while it is still enabled */
+	if(disp->keys_scan && step->plane == 0){
+		segdisp_keys_sample_i(disp);
+	}
+	chVTSetI(&disp->timer, segdisp_step_ticks(disp, step), segdisp_timer_cb, disp);
+	chSysUnlockFromISR();
+
+	segdisp_show_step(disp, step);
+	segdisp_step_next(disp);
 }
 
 /**
- * Display one character at specific position [internal]
- * @param disp     Display configuration structure
- * @param position Position
- * @param output   Output value (already mapped character to output number)
+ * Restarts the refresh stopped on a dark display, called on every update [internal]
+ * 
+ * Has to be called from the system locked state.
+ * @param disp Display configuration structure
  */
-void segdisp_show_digit(segdisp_t *disp, int position, int output){
-	int i;
-	if(position > disp->digits->number){
+static void segdisp_wake_i(segdisp_t *disp){
+	if(!disp->idle)
 		return;
+
+	disp->idle = false;
+	if(disp->refresh_mode == SEGDISP_REFRESH_TIMER){
+		chVTSetI(&disp->timer, 1, segdisp_timer_cb, disp);
 	}
-	for(i = 0; i < disp->digits->number; i++){
-		segdisp_dig_ena(disp, i, 0);
-	}
-	segdisp_dig_ena(disp, position, 1);
-	for(i = 0; i < disp->segments->number; i++){
-		segdisp_seg_out(disp, i, output & 1);
-		output = output >> 1;
+	else{
+		chThdResumeI(&disp->idle_thread, MSG_OK);
 	}
 }
 
 /**
- * Sets a character to the specified position that will be displayed [external API]
+ * Effective brightness level of one digit, with global brightness and gamma applied [internal]
  * @param  disp     Display configuration structure
  * @param  position Position
- * @param  output   Ascii character to display
- * @return          Returns -1 on failure, 0 on success
+ * @return          Level from 0 to SEGDISP_BRIGHTNESS_MAX
  */
-int segdisp_set(segdisp_t *disp, int position, char output){
-	int tmp;
-	if(position > disp->digits->number)
-		return -1;
+static int segdisp_level(segdisp_t *disp, int position){
+	int level = disp->brightness[position] * disp->brightness_global / SEGDISP_BRIGHTNESS_MAX;
 
-	if((disp->flags & SEGDISP_SEGMENTS_FLAG) == SEGDISP_SEGMENTS_SEVEN){
-		tmp = segdisp_7seg_char2int(output);
-	}
-	else{
-		tmp = segdisp_16seg_char2ing(output);
-	}
-	disp->actual[position] = tmp;
+	level = level * disp->anim_level / SEGDISP_BRIGHTNESS_MAX;
 
-	return 0;
+	if(disp->gamma != NULL){
+		level = disp->gamma[level];
+	}
+	return level;
 }
 
 /**
- * Move displayed text to the absolute position from the beginning [external API]
- * @param  disp   Display configuration structure
- * @param  offset Position to move the text to
- * @return        Returns -1 on failure, 0 on success
+ * Effective brightness level of one digit rounded to the number of planes [internal]
+ * @param  disp     Display configuration structure
+ * @param  position Position
+ * @param  planes   Number of planes
+ * @return          Level from 0 to (1 << planes) - 1
  */
-int segdisp_move_abs(segdisp_t *disp, int offset){
-	disp->offset = disp->buffer_strlen;
-	return segdisp_move_cont(disp, offset);
+static int segdisp_plane_level(segdisp_t *disp, int position, int planes){
+	int max = (1 << planes) - 1;
+
+	return (segdisp_level(disp, position) * max + SEGDISP_BRIGHTNESS_MAX / 2) / SEGDISP_BRIGHTNESS_MAX;
 }
 
 /**
- * Move displayed text relatively to current position [external API]
- * @param  disp  Display configuration structure
- * @param  step  Relative movement offset
- * @return       Returns -1 on failure, 0 on success
+ * Builds the table of multiplex steps [internal]
+ * 
+ * Without brightness control there's one step of refresh microseconds per digit.
+ * With it, slot of each digit is split into SEGDISP_BCM_PLANES sub-slots weighted 1, 2, 4, ...
+ * and the digit is lit in the sub-slots of the set bits of its level (binary code modulation).
+ * When the slot has fewer system ticks than the sub-slots need, fewer planes are used (bcm_planes)
+ * and the levels are rounded to them, so the frame keeps its period.
+ * Has to be called from the system locked state if the refresh is running.
+ * @param disp Display configuration structure
  */
-int segdisp_move_cont(segdisp_t *disp, int step){
+static void segdisp_steps_build(segdisp_t *disp){
+	systime_t ticks = US2ST(disp->refresh);
+	segdisp_step_t *step = disp->steps;
+	int planes = 1;
+	int level;
 	int i;
+	int k;
 
-	if(disp->scroll == NULL)
-		return -1;
-
-	chMtxLock(disp->string_buffer_mtx);
-	/* move the offset */
-	disp->offset += step;
-
-	if(disp->offset > disp->buffer_strlen){
-		disp->offset -= disp->buffer_strlen ;
+	if(ticks == 0){
+		ticks = 1;
 	}
-	else if(disp->offset < 0){
-		disp->offset += disp->buffer_strlen - 1;
+	if(disp->bcm){
+		planes = SEGDISP_BCM_PLANES;
+		while(planes > 1 && ticks < (systime_t) ((1 << planes) - 1)){
+			planes--;
+		}
+		ticks /= (1 << planes) - 1;
 	}
-	
-	/* shift the string */
-	utils_str_shift(disp->buffer, step);
-	chMtxUnlock(disp->string_buffer_mtx);
+	disp->bcm_planes = planes;
 
-	chMtxLock(disp->display_buffer_mtx);
-	for(i = 0; i < disp->digits->number; i++){
-		segdisp_set(disp, i, disp->buffer[i]);
+	disp->off_digits = 0;
+	if(disp->axis == SEGDISP_AXIS_SEGMENTS){
+		for(k = 0; k < planes; k++){
+			disp->plane_digits[k] = 0;
+		}
+		for(i = 0; i < disp->digits->number; i++){
+			level = disp->bcm ? segdisp_plane_level(disp, i, planes) : 1;
+			if(level == 0){
+				disp->off_digits |= 1UL << i;
+			}
+			for(k = 0; k < planes; k++){
+				disp->plane_digits[k] |= ((level >> k) & 1UL) << i;
+			}
+		}
+		for(i = 0; i < disp->segments->number; i++){
+			for(k = 0; k < planes; k++, step++){
+				step->digit = i;
+				step->plane = k;
+				step->ticks = ticks << k;
+				step->lit = disp->plane_digits[k] != 0;
+			}
+		}
+		disp->steps_number = disp->segments->number * planes;
+		disp->lines = disp->segments->number;
+		disp->step = 0;
+		return;
 	}
-	chMtxUnlock(disp->display_buffer_mtx);
 
-	return true;
+	for(i = 0; i < disp->digits->number; i++){
+		level = disp->bcm ? segdisp_plane_level(disp, i, planes) : 1;
+		if(level == 0){
+			disp->off_digits |= 1UL << i;
+		}
+		for(k = 0; k < planes; k++, step++){
+			step->digit = i;
+			step->plane = k;
+			step->ticks = ticks << k;
+			step->lit = (level >> k) & 1;
+		}
+	}
+	disp->steps_number = disp->digits->number * planes;
+	disp->lines = disp->digits->number;
+	disp->step = 0;
 }
 
 /**
- * Start the scrolling of the text. Scroll configuration structure has to be configured!
- * @param  disp 	Display configuration structure
- * @param  priority Scroll thread priority
- * @return     		Returns -1 on failure, 0 on success
+ * Rebuilds the step table after brightness change, from the system locked state [internal]
+ * @param disp Display configuration structure
  */
-int segdisp_scroll_run(segdisp_t *disp, tprio_t priority){
-	if(disp->scroll == NULL)
-		return -1;
-
-	if(disp->scroll_thd != NULL)
-		return -1;
+static void segdisp_brightness_update_i(segdisp_t *disp){
+	int i;
 
-	disp->scroll_thd = chThdCreateFromHeap(NULL, THD_WORKING_AREA_SIZE(128), priority, segdisp_scroll_thread, disp);
-	if(disp->thread == NULL){
-		return -1;
+	disp->bcm = disp->gamma != NULL || disp->brightness_global != SEGDISP_BRIGHTNESS_MAX ||
+		disp->anim_level != SEGDISP_BRIGHTNESS_MAX;
+	for(i = 0; i < disp->digits->number && !disp->bcm; i++){
+		disp->bcm = disp->brightness[i] != SEGDISP_BRIGHTNESS_MAX;
 	}
-	return 1;
+	segdisp_steps_build(disp);
+	segdisp_wake_i(disp);
 }
 
 /**
- * Stop the scrolling
- * @param disp Display confguration structure
+ * Rebuilds the step table after brightness change [internal]
+ * 
+ * A running refresh walks the step table without the lock, so the table is only marked
+ * to be rebuilt by segdisp_frame_i at the next frame boundary.
+ * @param disp Display configuration structure
  */
-void segdisp_scroll_stop(segdisp_t *disp){
-	chThdTerminate(disp->scroll_thd);
-	disp->scroll_thd = NULL;
+static void segdisp_brightness_update(segdisp_t *disp){
+	chSysLock();
+	if(disp->refresh_mode == SEGDISP_REFRESH_STOPPED || disp->refresh_mode == SEGDISP_REFRESH_DMA){
+		segdisp_brightness_update_i(disp);
+	}
+	else{
+		disp->brightness_pending = true;
+		segdisp_wake_i(disp);
+	}
+	chSchRescheduleS();
+	chSysUnlock();
 }
 
 /**
- * Run the display refresh
+ * Set brightness of one digit [external API]
  * @param  disp     Display configuration structure
- * @param  priority Priority of the 
+ * @param  position Position
+ * @param  level    Brightness level from 0 (off) to SEGDISP_BRIGHTNESS_MAX (full, default)
  * @return          Returns -1 on failure, 0 on success
  */
-int segdisp_run(segdisp_t *disp, tprio_t priority){
-	if(disp->thread != NULL)
+int segdisp_set_brightness(segdisp_t *disp, int position, uint8_t level){
+	if(position < 0 || position >= disp->digits->number || level > SEGDISP_BRIGHTNESS_MAX)
 		return -1;
 
-	disp->thread = chThdCreateFromHeap(NULL, THD_WORKING_AREA_SIZE(128), priority, segdisp_refresh_thread, disp);
-	if(disp->thread == NULL)
+	disp->brightness[position] = level;
+	segdisp_brightness_update(disp);
+	return 0;
+}
+
+/**
+ * Set brightness of the whole display, it scales the brightness of the digits [external API]
+ * @param  disp  Display configuration structure
+ * @param  level Brightness level from 0 (off) to SEGDISP_BRIGHTNESS_MAX (full, default)
+ * @return       Returns -1 on failure, 0 on success
+ */
+int segdisp_set_global_brightness(segdisp_t *disp, uint8_t level){
+	if(level > SEGDISP_BRIGHTNESS_MAX)
 		return -1;
 
+	disp->brightness_global = level;
+	segdisp_brightness_update(disp);
 	return 0;
 }
 
 /**
- * Stop display refresh
- * @param disp Display configuration structure
+ * Set gamma table mapping brightness level to the lit time [external API]
+ * @param disp  Display configuration structure
+ * @param gamma Table of SEGDISP_BRIGHTNESS_MAX + 1 levels, NULL for linear mapping
  */
-void segdisp_stop(segdisp_t *disp){
-	segdisp_set_str(disp, " ");
-	chThdTerminate(disp->thread);
+void segdisp_set_gamma(segdisp_t *disp, const uint8_t *gamma){
+	disp->gamma = gamma;
+	segdisp_brightness_update(disp);
 }
 
 /**
- * Set string to display
+ * Prepares the display for refresh driven in the given mode [internal]
  * @param  disp Display configuration structure
- * @param  text Pointer to the string to display
- * @return      Returns -1 on failure, 0 on success
+ * @param  mode Refresh mode, SEGDISP_REFRESH_THREAD, SEGDISP_REFRESH_TIMER or SEGDISP_REFRESH_MANAGED
+ * @return      Returns -1 if the refresh is already running, 0 on success
  */
-int segdisp_set_str(segdisp_t *disp, char *text){
-	if(text == NULL)
-		return -1;
-	if(strlen(text) < 1)
+int segdisp_refresh_start(segdisp_t *disp, uint8_t mode){
+	if(disp->thread != NULL || disp->refresh_mode != SEGDISP_REFRESH_STOPPED)
 		return -1;
 
-	disp->buffer = text;
-	disp->buffer_strlen = strlen(disp->buffer);
+	chSysLock();
+	disp->anim = NULL;
+	disp->shown = disp->actual;
+	disp->anim_blank = 0;
+	disp->anim_level = SEGDISP_BRIGHTNESS_MAX;
+	disp->idle = false;
+	disp->dark = 0;
+	disp->step_first = 0;
+	disp->keys_scan = disp->keys != NULL && (mode == SEGDISP_REFRESH_THREAD || mode == SEGDISP_REFRESH_TIMER);
+	disp->keys_digit = -1;
+	disp->brightness_pending = false;
+	segdisp_brightness_update_i(disp);
+	chSysUnlock();
+	disp->refresh_mode = mode;
+	return 0;
+}
 
-	// redraw the text by moving it to current position 
-	segdisp_move_abs(disp, 0);
+/**
+ * Does the next step of the multiplex, new content is taken at the frame boundary [internal]
+ * @param  disp Display configuration structure
+ * @return      Duration of the step in system ticks, 0 if the display is dark and the refresh should wait
+ */
+systime_t segdisp_refresh_step(segdisp_t *disp){
+	const segdisp_step_t *step;
+
+	if(disp->step == 0){
+		chSysLock();
+		segdisp_frame_i(disp);
+		/* the frame may have broadcast the animation end */
+		chSchRescheduleS();
+		chSysUnlock();
+		if(disp->idle){
+			segdisp_blank(disp);
+			return 0;
+		}
+	}
+	step = &disp->steps[disp->step];
+	if(disp->keys_scan && step->plane == 0){
+		chSysLock();
+		segdisp_keys_sample_i(disp);
+		chSchRescheduleS();
+		chSysUnlock();
+	}
+	segdisp_show_step(disp, step);
+	segdisp_step_next(disp);
 
-	return 0;
+	return segdisp_step_ticks(disp, step);
 }
 
 /**
- * Function mapping a character to an integer output for 7 segment display
- * @param  c Character to map
- * @return   Integer whose bits are representing individual segments of the display
+ * Initializes the display with the given storage [internal]
+ * @param  disp     Pointer to allocated segdisp_t structure
+ * @param  segments Segment pins
+ * @param  digits   Digit pins
+ * @param  flags    Configuration flags
+ * @param  storage  Storage sized for at least the number of digits
+ * @return          Returns -1 on failure, 0 on success
  */
-uint32_t segdisp_7seg_char2int(char c){
-	uint32_t out;
-	switch(c){
-		// case 0:
-		case ' ':
-			out = 0;
-		break;
-
-		case '-':
-			out = 0b1000000;
-		break;
-
-		case '0':
-			out = 0b0111111;
-		break;
-
-		case '1':
-			out = 0b0000110;
-		break;
-
-		case '2':
-			out = 0b1011011;
-		break;
-
-		case '3':
-			out = 0b1001111;
-		break;
-
-		case '4':
-			out = 0b1100110;
-		break;
-
-		case '5':
-			out = 0b1101101;
-		break;
-
-		case '6':
-			out = 0b1111101;
-		break;
-
-		case '7':
-			out = 0b0000111;
-		break;
-
-		case '8':
-			out = 0b1111111;
-		break;
-
-		case '9':
-			out = 0b1101111;
-		break;
-
-		case 'a':
-		case 'A':
-			out = 0b1110111;
-			break;
+static int segdisp_init_storage(segdisp_t *disp, segdisp_pins_t *segments, segdisp_pins_t *digits, uint8_t flags,
+	const segdisp_storage_t *storage){
+	int i;
 
-		case 'b':
-		case 'B':
-			out = 0b1111100;
-			break;
+	if(segments->number > SEGDISP_MAX_SEGMENTS || digits->number > SEGDISP_MAX_DIGITS){
+		return -1;
+	}
 
-		case 'c':
-		case 'C':
-			out = 0b0111001;
-			break;
+	/* the step table is sized by the digits */
+	if((flags & SEGDISP_AXIS_FLAG) == SEGDISP_AXIS_SEGMENTS && segments->number > digits->number){
+		return -1;
+	}
+	if((flags & SEGDISP_AXIS_FLAG) == SEGDISP_AXIS_SEGMENTS ||
+		((flags & SEGDISP_AXIS_FLAG) == SEGDISP_AXIS_AUTO && segments->number < digits->number)){
+		disp->axis = SEGDISP_AXIS_SEGMENTS;
+	}
+	else{
+		disp->axis = SEGDISP_AXIS_DIGITS;
+	}
 
-		case 'd':
-		case 'D':
-			out = 0b1011110;
-			break;
+	disp->segments = segments;
+	disp->backend = &segdisp_gpio_backend;
+	disp->digits = digits;
 
-		case 'e':
-		case 'E':
-			out = 0b1111001;
-			break;
+	disp->flags = flags;
+	if((flags & SEGDISP_SEGMENTS_FLAG) == SEGDISP_SEGMENTS_SEVEN){
+		disp->font = segdisp_font_7seg;
+	}
+	else{
+		disp->font = segdisp_font_16seg;
+	}
+	disp->font_polarized = 0;
+
+	disp->actual = storage->fb;
+	disp->back = disp->actual + digits->number;
+	disp->swap_pending = false;
+	disp->shown = disp->actual;
+	disp->dirty = disp->back + digits->number;
+	disp->touched = 0;
+	disp->touched_total = 0;
+	disp->updates_skipped = 0;
+	disp->writer_active = false;
+	disp->msg_active = false;
+	disp->scroll_running = false;
+	disp->scroll_due = 0;
+	disp->scroll_shift = 0;
+	chVTObjectInit(&disp->scroll_timer);
+	disp->mbox = NULL;
+	disp->mbox_fresh = false;
+	disp->mbox_posts = 0;
+	disp->mbox_applied = 0;
+	disp->anim = NULL;
+	disp->anim_blank = 0;
+	disp->anim_level = SEGDISP_BRIGHTNESS_MAX;
+	chEvtObjectInit(&disp->anim_event);
+	disp->keys = NULL;
+	disp->keys_scan = false;
+	disp->keys_digit = -1;
+	disp->keys_lost = 0;
+	chEvtObjectInit(&disp->keys_event);
+	for(i = 0; i < 2 * digits->number; i++){
+		disp->actual[i] = disp->font[' '];
+	}
 
-		case 'f':
-		case 'F':
-			out = 0b1110001;
-			break;
+	disp->buffer = storage->msg;
+	disp->buffer_size = storage->msg != NULL ? storage->msg_size : 0;
+	disp->buffer_owned = false;
+	disp->buffer_window = 0;
+	disp->offset = 0;
+
+	disp->display_buffer_mtx = &storage->mutexes[0];
+	disp->string_buffer_mtx = &storage->mutexes[1];
+
+	disp->refresh = 5000;
+	disp->thread = NULL;
+	disp->wa = storage->wa;
+	disp->wa_size = storage->wa_size;
+
+	disp->dig_plan = storage->dig_plan;
+	if(segdisp_plan_build(disp) != 0){
+		return -1;
+	}
+
+	disp->steps = storage->steps;
+	disp->brightness = storage->brightness;
+	memset(disp->brightness, SEGDISP_BRIGHTNESS_MAX, digits->number);
+	disp->brightness_global = SEGDISP_BRIGHTNESS_MAX;
+	disp->gamma = NULL;
+	disp->bcm = false;
+	disp->bcm_planes = 1;
+	disp->brightness_pending = false;
+	disp->refresh_mode = SEGDISP_REFRESH_STOPPED;
+	disp->dark = 0;
+	disp->step_first = 0;
+	disp->idle = false;
+	disp->idle_count = 0;
+	disp->idle_thread = NULL;
+	chVTObjectInit(&disp->timer);
+	disp->mgr_mtx = NULL;
+	disp->dma = NULL;
+	disp->dma_words = NULL;
+	disp->writes_avoided = 0;
+#if SEGDISP_USE_STATS == TRUE
+	memset(&disp->stats, 0, sizeof(disp->stats));
+	disp->stats_seq = 0;
+	disp->stats_lock_blocked = 0;
+	disp->stats_lock_wait = 0;
+	disp->stats_lock_wait_max = 0;
+	disp->stats_moves = 0;
+	disp->stats_scrolled = 0;
+	disp->stats_window_frames = 0;
+	disp->stats_last_lit = false;
+#endif
+
+	for(i = 0; i < disp->segments->number; i++){
+		if(disp->segments->pins[i].port != NULL){
+			palSetPadMode((ioportid_t) disp->segments->pins[i].port, disp->segments->pins[i].pin, PAL_MODE_OUTPUT_PUSHPULL);
+		}
+	}
 
-		default:
-			out = 0b0011100;
-		break;
+	for(i = 0; i < disp->digits->number; i++){
+		if(disp->digits->pins[i].port != NULL){
+			palSetPadMode((ioportid_t) disp->digits->pins[i].port, disp->digits->pins[i].pin, PAL_MODE_OUTPUT_PUSHPULL);
+		}
 	}
 
-	return out;
+	segdisp_blank(disp);
+
+	chMtxObjectInit(disp->display_buffer_mtx);
+	chMtxObjectInit(disp->string_buffer_mtx);
+
+	return 0 ;
 }
 
 /**
- * Function mapping a character to an integer output for 16 segment display
- * @param  c Character to map
- * @return   Integer whose bits are representing individual segments of the display
+ * @brief Initializes the Display configuration structure [external API]
+ * 
+ * The buffers and mutexes are taken from the core memory, which is never freed, so each call
+ * takes new memory. A display initialized repeatedly has to use segdisp_init_static.
+ * @param disp     Pointer to allocated segdisp_t structure
+ * @param segments Pointer to allocated and configured segdisp_pins_t structure defining the segments of one digit
+ * @param digits   Pointer to allocated and configured segdisp_pins_t structure defining the digits
+ * @param flags    Configuring flags
+ * rReturn		   Returns -1 on failure, 0 on success.
  */
-uint32_t segdisp_16seg_char2ing(char c){
-	uint32_t out;
-	switch(c){
-		case 'A':
-			out = 0b0000001111001111;
-			break;
-		case 'a':
-			out = 0b0100010101010000;
-			break;
-		case 'B':
-			out = 0b0100101000111111;
-		case 'b':
-			out = 0b0100000111010000;
-			break;
-		case 'C':
-			out = 0b0000000101010000;
-			break;
-		case 'c':
-			out = 0b0000000101010000;
-			break;
-		case 'D':
-			out = 0b0100100000111111; 
-			break;
-		case 'd':
-			out = 0b0100100101010000;
-			break;
-		case 'E':
-			out = 0b0000000111110011;
-			break;
-		case 'e':
-			out = 0b1000000101110000;
-			break;
-		case 'F':
-			out = 0b0000000111000011;
-			break;
-		case 'f':
-			out = 0b0100101100000010;
-			break;
-		case 'G':
-			out = 0b0000001011111011;
-			break;
-		case 'g':
-			out = 0b0100100110010001;
-			break;
-		case 'H':
-			out = 0b0000001111001100;
-			break; 
-		case 'h':
-			out = 0b0100000111000000;
-			break;
-		case 'I':
-			out = 0b0100100000110011;
-			break;
-		case 'i':
-			out = 0b0100000000000000;
-			break;
-		case 'J':
-			out = 0b0000000001111100;
-			break;
-		case 'j':
-			out = 0b0100100001010000;
-			break;
-		case 'K':
-			out = 0b0011000111000000;
-			break;
-		case 'k':
-			out = 0b0111100000000000;
-			break;
-		case 'L':
-			out = 0b0000000011110000;
-			break;
-		case 'l':
-			out = 0b0100100000000000;
-			break;
-		case 'M':
-			out = 0b0001010011001100;
-			break;
-		case 'm':
-			out = 0b0100001101001000;
-			break;
-		case 'N':
-			out = 0b0010010011001100;
-			break;
-		case 'n':
-			out = 0b0100000101000000;
-			break;
-		case 'O':
-			out = 0b0000000011111111;
-			break;
-		case 'o':
-			out = 0b0100000101010000;
-			break;
-		case 'P':
-			out = 0b0000001111000111;
-			break;
-		case 'p':
-			out = 0b0000100111000001;
-			break;
-		case 'Q':
-			out = 0b0010000011111111;
-			break;
-		case 'q':
-			out = 0b0100100110000001;
-			break;
-		case 'R':
-			out = 0b0010001111000111;
-			break;
-		case 'r':
-			out = 0b0000000101000000;
-			break;
-		case 'S':
-			out = 0b0000001110111011;
-			break;
-		case 's':
-			out = 0b0100000110010001;
-			break;
-		case 'T':
-			out = 0b0100100000000011;
-			break;
-		case 't':
-			out = 0b0100101100000000;
-			break;
-		case 'U':
-			out = 0b0000000011111100;
-			break;
-		case 'u':
-			out = 0b0100000001010000;
-			break;
-		case 'V':
-			out = 0b1001000011000000;
-			break;
-		case 'v':
-			out = 0b1000000001000000;
-			break;
-		case 'W':
-			out = 0b1010000011001100;
-			break;
-		case 'w':
-			out = 0b1010000001001000;
-			break;
-		case 'X':
-			out = 0b1011010000000000;
-			break;
-		case 'x':
-			out = 0b1011010000000000;
-			break;
-		case 'Y':
-			out = 0b0100001110000100;
-			break;
-		case 'y':
-			out = 0b0101010000000000;
-			break;
-		case 'Z':
-			out = 0b1001000000110011;
-			break;
-		case 'z':
-			out = 0b1000000100010000;
-			break;
-		case '0':
-			out = 0b1001000011111111;
-			break;
-		case '1':
-			out = 0b0001000000001100;
-			break;
-		case '2':
-			out = 0b0000001101110111;
-			break;
-		case '3':
-			out = 0b0000001000111111;
-			break;
-		case '4':
-			out = 0b0000001110001100;
-			break;
-		case '5':
-			out = 0b0000001110111011;
-			break;
-		case '6':
-			out = 0b0000001111111001;
-			break;
-		case '7':
-			out = 0b0000000000001111;
-			break;
-		case '8':
-			out = 0b0000001111111111;
-			break;
-		case '9':
-			out = 0b0000001110101111;
-			break;
-		case '=':
-			out = 0b0000001100110000;
-			break;
-		case '*':
-			out = 0b1111111100000000;
-			break;
-		case '+':
-			out = 0b0100101100000000;
-			break;
-		case '-':
-			out = 0b0000001100000000;
-			break;
-		case '.':
-			out = 0b10000000000000000;
-			break;
-		case '|':
-			out = 0b0100100000000000;
-			break;
-		case '\\':
-			out = 0b0010010000000000;
-			break;
-		case '/':
-			out = 0b1001000000000000;
-			break;
-		case '_':
-			out = 0b0000000000110000;
-			break;
-		case '?':
-			out = 0b10100001000000111;
-			break;
-		case '!':
-			out = 0b10000000000001100;
-			break;
-		case '(':
-		case '[':
-			out = 0b0100100000100010;
-			break;
-		case ')':
-		case ']':
-			out = 0b0100100000010001;
-			break;
-		case '<':
-			out = 0b0011000000000000;
-			break;
-		case '>':
-			out = 0b1000010000000000;
-			break;
-		case '{':
-			out = 0b0100100100100010;
-			break;
-		case '}':
-			out = 0b0100101000010001;
+int segdisp_init(segdisp_t *disp, segdisp_pins_t *segments, segdisp_pins_t *digits, uint8_t flags){
+	segdisp_storage_t storage;
+
+	storage.digits = digits->number;
+	storage.fb = chCoreAlloc((2 * digits->number + SEGDISP_DIRTY_WORDS(digits->number)) * sizeof(uint32_t));
+	storage.dig_plan = chCoreAlloc(digits->number * sizeof(segdisp_pin_plan_t));
+	storage.steps = chCoreAlloc(digits->number * SEGDISP_BCM_PLANES * sizeof(segdisp_step_t));
+	storage.brightness = chCoreAlloc(digits->number);
+	storage.mutexes = chCoreAlloc(2 * sizeof(mutex_t));
+	storage.wa = NULL;
+	storage.wa_size = 0;
+	storage.msg = NULL;
+	storage.msg_size = 0;
+	if(storage.fb == NULL || storage.dig_plan == NULL || storage.steps == NULL || storage.brightness == NULL ||
+		storage.mutexes == NULL){
+		return -1;
+	}
+
+	return segdisp_init_storage(disp, segments, digits, flags, &storage);
+}
+
+/**
+ * @brief Initializes the display without any dynamic allocation [external API]
+ * 
+ * Everything is kept in the storage declared by SEGDISP_STORAGE, the refresh thread runs in its
+ * working area. The display can be initialized again with the same storage when it's stopped.
+ * @param disp     Pointer to allocated segdisp_t structure
+ * @param segments Pointer to allocated and configured segdisp_pins_t structure defining the segments of one digit
+ * @param digits   Pointer to allocated and configured segdisp_pins_t structure defining the digits
+ * @param flags    Configuration flags, see segdisp_init
+ * @param storage  Storage declared by SEGDISP_STORAGE for at least the number of digits
+ * @return         Returns -1 on failure, 0 on success
+ */
+int segdisp_init_static(segdisp_t *disp, segdisp_pins_t *segments, segdisp_pins_t *digits, uint8_t flags,
+	const segdisp_storage_t *storage){
+	if(storage == NULL || storage->digits < digits->number)
+		return -1;
+
+	return segdisp_init_storage(disp, segments, digits, flags, storage);
+}
+
+/**
+ * Set output value for specific segment (one segment enable) [internal]
+ * @param disp Display configuration structure
+ * @param seg  Segment number
+ * @param out  Output value
+ */
+void segdisp_seg_out(segdisp_t *disp, int seg, int out){
+	disp->out_valid = false;
+	if((disp->flags & SEGDISP_DRIVER_FLAG) == SEGDISP_INVERTED_DRIVER){
+		if(out){
+			palClearPad((ioportid_t) disp->segments->pins[seg].port, disp->segments->pins[seg].pin);
+		}
+		else{
+			palSetPad((ioportid_t) disp->segments->pins[seg].port, disp->segments->pins[seg].pin);
+		}
+	}
+	else{
+		if(out){
+			palSetPad((ioportid_t) disp->segments->pins[seg].port, disp->segments->pins[seg].pin);
+		}
+		else{
+			palClearPad((ioportid_t) disp->segments->pins[seg].port, disp->segments->pins[seg].pin);
+		}
+	}
+}
+
+/**
+ * Set output value for specific digit (common electrode enable) [internal]
+ * @param disp  Display configuration structure
+ * @param digit Digit number
+ * @param out   Output value
+ */
+void segdisp_dig_ena(segdisp_t *disp, int digit, int out){
+	disp->out_valid = false;
+
+	if((disp->flags & SEGDISP_COMMON_ELECTRODE_FLAG) == SEGDISP_INVERTED_SEGMENT){
+		if(out){
+			palSetPad((ioportid_t) disp->digits->pins[digit].port, disp->digits->pins[digit].pin);
+		}
+		else{
+			palClearPad((ioportid_t) disp->digits->pins[digit].port, disp->digits->pins[digit].pin);
+		}
+	}
+	else{
+		if(out){
+			palClearPad((ioportid_t) disp->digits->pins[digit].port, disp->digits->pins[digit].pin);
+		}
+		else{
+			palSetPad((ioportid_t) disp->digits->pins[digit].port, disp->digits->pins[digit].pin);
+		}
+	}
+}
+
+/**
+ * Forgets the levels written by the last phase, the next phase writes all the pins [external API]
+ * 
+ * The phases write only the pins that change, call it when something else wrote the pins of the display.
+ * @param disp Display configuration structure
+ */
+void segdisp_out_invalidate(segdisp_t *disp){
+	disp->out_valid = false;
+	if(disp->backend->invalidate != NULL){
+		disp->backend->invalidate(disp->backend->ctx);
+	}
+}
+
+/**
+ * Turns all digits and segments off [internal]
+ * @param disp Display configuration structure
+ */
+void segdisp_blank(segdisp_t *disp){
+	disp->backend->phase(disp->backend->ctx, disp, 0, 0);
+}
+
+/**
+ * Locks display_buffer_mtx for a writer, counting the time it was blocked [internal]
+ * @param disp Display configuration structure
+ */
+static void segdisp_writer_lock(segdisp_t *disp){
+#if SEGDISP_USE_STATS == TRUE
+	rtcnt_t start;
+	rtcnt_t wait;
+
+	if(chMtxTryLock(disp->display_buffer_mtx))
+		return;
+
+	start = chSysGetRealtimeCounterX();
+	chMtxLock(disp->display_buffer_mtx);
+	wait = chSysGetRealtimeCounterX() - start;
+	disp->stats_lock_blocked++;
+	disp->stats_lock_wait += wait;
+	if(wait > disp->stats_lock_wait_max)
+		disp->stats_lock_wait_max = wait;
+#else
+	chMtxLock(disp->display_buffer_mtx);
+#endif
+}
+
+/**
+ * Prepares the back buffer for writing [internal]
+ * 
+ * A frame published but not yet taken by the refresh is withdrawn and updated in place,
+ * otherwise the back buffer is synchronized with the displayed one on the first change.
+ * Caller has to hold display_buffer_mtx.
+ * @param disp Display configuration structure
+ */
+static void segdisp_fb_begin(segdisp_t *disp){
+	chSysLock();
+	disp->fb_withdrawn = disp->swap_pending;
+	disp->swap_pending = false;
+	disp->writer_active = true;
+	chSysUnlock();
+
+	disp->fb_synced = disp->fb_withdrawn;
+	disp->touched = 0;
+	memset(disp->dirty, 0, SEGDISP_DIRTY_WORDS(disp->digits->number) * sizeof(*disp->dirty));
+}
+
+/**
+ * Writes output code to the back buffer if it differs from the current content [internal]
+ * 
+ * Caller has to hold display_buffer_mtx and begin the back buffer.
+ * @param disp     Display configuration structure
+ * @param position Position
+ * @param code     Output value
+ */
+static inline void segdisp_fb_write(segdisp_t *disp, int position, uint32_t code){
+	const uint32_t *current = disp->fb_synced ? disp->back : disp->actual;
+
+	if(current[position] == code)
+		return;
+
+	if(!disp->fb_synced){
+		memcpy(disp->back, disp->actual, disp->digits->number * sizeof(*disp->actual));
+		disp->fb_synced = true;
+	}
+	disp->back[position] = code;
+	disp->dirty[position >> 5] |= 1UL << (position & 31);
+	disp->touched++;
+}
+
+/**
+ * Publishes the back buffer, the refresh takes it at the next frame boundary [internal]
+ * 
+ * Nothing is published when no cell changed. Caller has to hold display_buffer_mtx.
+ * @param disp Display configuration structure
+ */
+static void segdisp_fb_publish(segdisp_t *disp){
+	if(disp->touched == 0 && !disp->fb_withdrawn){
+		disp->updates_skipped++;
+		chSysLock();
+		disp->writer_active = false;
+		chSysUnlock();
+		return;
+	}
+	disp->touched_total += disp->touched;
+
+	chSysLock();
+	disp->writer_active = false;
+	disp->swap_pending = true;
+	/* nobody else would take it */
+	if(disp->refresh_mode == SEGDISP_REFRESH_STOPPED || disp->refresh_mode == SEGDISP_REFRESH_DMA){
+		segdisp_fb_swap_i(disp);
+	}
+	/* the scroll timer rewrites the dirty cells and the words too, so it must not come in between */
+	if(disp->refresh_mode == SEGDISP_REFRESH_DMA){
+		segdisp_dma_update_i(disp);
+	}
+	segdisp_wake_i(disp);
+	chSchRescheduleS();
+	chSysUnlock();
+}
+
+/**
+ * Swaps the front and back buffer if there's a published frame [internal]
+ * 
+ * Has to be called from the system locked state.
+ * @param disp Display configuration structure
+ */
+static void segdisp_fb_swap_i(segdisp_t *disp){
+	uint32_t *tmp;
+
+	if(disp->swap_pending){
+		tmp = disp->actual;
+		disp->actual = disp->back;
+		disp->back = tmp;
+		disp->swap_pending = false;
+	}
+}
+
+/**
+ * Applies the latest update posted to the mailbox to the front buffer [internal]
+ * 
+ * Nothing is done while a writer works on the back buffer, the update waits for the next frame then.
+ * Has to be called with the system lock held.
+ * @param  disp Display configuration structure
+ * @return      Returns 1 if an update was applied, 0 otherwise
+ */
+static int segdisp_mbox_apply_i(segdisp_t *disp){
+	uint8_t slot;
+
+	if(!disp->mbox_fresh || disp->writer_active)
+		return 0;
+
+	slot = disp->mbox_ready;
+	disp->mbox_ready = disp->mbox_read;
+	disp->mbox_read = slot;
+	disp->mbox_fresh = false;
+	memcpy(disp->actual, disp->mbox + slot * disp->digits->number, disp->digits->number * sizeof(*disp->actual));
+	disp->mbox_applied++;
+
+	return 1;
+}
+
+/**
+ * Takes the new content of the display at the frame boundary [internal]
+ * 
+ * With SEGDISP_BLANK_SKIPPED the dark lines of the frame are found, the frame starts with the first lit one
+ * and the display goes idle when there's none. Has to be called with the system lock held.
+ * @param disp Display configuration structure
+ */
+static void segdisp_frame_i(segdisp_t *disp){
+	uint32_t dark = 0;
+	uint32_t lit;
+	int i;
+
+	segdisp_fb_swap_i(disp);
+	segdisp_mbox_apply_i(disp);
+	segdisp_scroll_apply_i(disp);
+	segdisp_anim_step_i(disp);
+	if(disp->brightness_pending){
+		disp->brightness_pending = false;
+		segdisp_brightness_update_i(disp);
+	}
+
+	if(disp->axis == SEGDISP_AXIS_SEGMENTS){
+		for(i = 0; i < disp->segments->number; i++){
+			disp->axis_masks[i] = 0;
+		}
+		for(i = 0; i < disp->digits->number; i++){
+			if(((disp->anim_blank | disp->off_digits) >> i) & 1)
+				continue;
+			for(lit = (disp->shown[i] ^ disp->seg_invert) & disp->seg_mask; lit != 0; lit &= lit - 1){
+				disp->axis_masks[__builtin_ctz(lit)] |= 1UL << i;
+			}
+		}
+	}
+
+	disp->dark = 0;
+	disp->step_first = 0;
+	/* scanned keys need every digit enabled in every frame */
+	if((disp->flags & SEGDISP_BLANK_FLAG) != SEGDISP_BLANK_SKIPPED || disp->keys_scan ||
+		(disp->refresh_mode != SEGDISP_REFRESH_THREAD && disp->refresh_mode != SEGDISP_REFRESH_TIMER))
+		return;
+
+	if(disp->axis == SEGDISP_AXIS_SEGMENTS){
+		for(i = 0; i < disp->lines; i++){
+			if(disp->axis_masks[i] == 0){
+				dark |= 1UL << i;
+			}
+		}
+	}
+	else{
+		for(i = 0; i < disp->lines; i++){
+			if(((disp->anim_blank | disp->off_digits) >> i) & 1 ||
+				((disp->shown[i] ^ disp->seg_invert) & disp->seg_mask) == 0){
+				dark |= 1UL << i;
+			}
+		}
+	}
+	disp->lines_lit = disp->lines - __builtin_popcount(dark);
+
+	if(disp->lines_lit == 0){
+		/* the animation goes on even when all its frames are dark */
+		if(disp->anim == NULL){
+			disp->idle = true;
+			disp->idle_count++;
+		}
+		return;
+	}
+
+	disp->dark = dark;
+	while((dark >> disp->steps[disp->step_first].digit) & 1){
+		disp->step_first++;
+	}
+	disp->step = disp->step_first;
+}
+
+/**
+ * Computes levels of all the ports for one multiplex phase [internal]
+ * @param disp       Display configuration structure
+ * @param digit_mask Enabled digits
+ * @param output     Output value (already mapped character to output number)
+ * @param bits       Levels of the ports in the order of the plan
+ */
+static inline void segdisp_phase_levels(segdisp_t *disp, uint32_t digit_mask, uint32_t output, ioportmask_t *bits){
+	const segdisp_pin_plan_t *pin;
+	int i;
+
+	for(i = 0; i < disp->ports_number; i++){
+		bits[i] = disp->ports[i].idle;
+	}
+
+	/* lighting a segment or enabling a digit flips its pin from the idle level */
+	for(; digit_mask != 0; digit_mask &= digit_mask - 1){
+		pin = &disp->dig_plan[__builtin_ctz(digit_mask)];
+		bits[pin->port] ^= PAL_PORT_BIT(pin->pin);
+	}
+
+	output &= disp->seg_mask;
+	for(pin = disp->seg_plan; output != 0; pin++, output >>= 1){
+		bits[pin->port] ^= PAL_PORT_BIT(pin->pin) & -(output & 1);
+	}
+}
+
+/**
+ * Shows one multiplex phase on the GPIO pins of the plan [internal]
+ * 
+ * All pins are written at once, with one write per GPIO port.
+ * @param ctx        Not used
+ * @param disp       Display configuration structure
+ * @param digit_mask Enabled digits, 0 for all pins at idle level
+ * @param segments   Output value (already mapped character to output number)
+ */
+static void segdisp_gpio_phase(void *ctx, segdisp_t *disp, uint32_t digit_mask, uint32_t segments){
+	ioportmask_t bits[SEGDISP_MAX_PORTS];
+	int i;
+
+	(void) ctx;
+	/* with a polarized font, the segments are off at seg_invert */
+	segdisp_phase_levels(disp, digit_mask, digit_mask != 0 ? segments : disp->seg_invert, bits);
+
+	if(!disp->out_valid){
+		for(i = 0; i < disp->ports_number; i++){
+			palWriteGroup(disp->ports[i].port, disp->ports[i].mask, 0, bits[i]);
+			disp->ports[i].last = bits[i];
+		}
+		disp->out_valid = true;
+		return;
+	}
+
+	/* only the pins that change are written, ports without a change are skipped */
+	for(i = 0; i < disp->ports_number; i++){
+		if(bits[i] == disp->ports[i].last){
+			disp->writes_avoided++;
+			continue;
+		}
+		palWriteGroup(disp->ports[i].port, bits[i] ^ disp->ports[i].last, 0, bits[i]);
+		disp->ports[i].last = bits[i];
+	}
+}
+
+/** Backend driving the segment and digit pins directly, one write per GPIO port */
+const segdisp_backend_t segdisp_gpio_backend = {segdisp_gpio_phase, NULL, NULL, NULL};
+
+/**
+ * Display one character at specific position [internal]
+ * @param disp     Display configuration structure
+ * @param position Position
+ * @param output   Output value (already mapped character to output number)
+ */
+void segdisp_show_digit(segdisp_t *disp, int position, int output){
+	if(position >= disp->digits->number){
+		return;
+	}
+
+	disp->backend->phase(disp->backend->ctx, disp, 1UL << position, (uint32_t) output);
+}
+
+/**
+ * Does one step of the multiplex, the digit is lit or dark according to the step [internal]
+ * @param disp Display configuration structure
+ * @param step Step to do
+ */
+static inline void segdisp_show_step(segdisp_t *disp, const segdisp_step_t *step){
+#if SEGDISP_USE_STATS == TRUE
+	segdisp_stats_t *st = &disp->stats;
+	rtcnt_t now = chSysGetRealtimeCounterX();
+	rtcnt_t d;
+
+	/* the refresh part of the statistics is written only here, readers retry while the
+	 * sequence is odd or changed; the writer and scroll counters are kept apart per
+	 * context, see segdisp_stats_get */
+	disp->stats_seq++;
+	__sync_synchronize();
+	if(st->steps != 0 && disp->stats_last_lit){
+		d = now - disp->stats_last_step;
+		if(st->on_count == 0 || d < st->on_min)
+			st->on_min = d;
+		if(d > st->on_max)
+			st->on_max = d;
+		st->on_sum += d;
+		st->on_count++;
+	}
+	if(disp->step == disp->step_first){
+		systime_t t = chVTGetSystemTimeX();
+		if(st->frames != 0){
+			d = now - disp->stats_last_frame;
+			if(d > st->frame_max)
+				st->frame_max = d;
+		}
+		else{
+			disp->stats_window = t;
+		}
+		st->frames++;
+		disp->stats_window_frames++;
+		if((systime_t) (t - disp->stats_window) >= S2ST(1)){
+			st->fps = (uint32_t) (((uint64_t) disp->stats_window_frames * S2ST(1)) / (systime_t) (t - disp->stats_window));
+			disp->stats_window = t;
+			disp->stats_window_frames = 0;
+		}
+		disp->stats_last_frame = now;
+	}
+	st->steps++;
+	disp->stats_last_step = now;
+	disp->stats_last_lit = step->lit;
+#endif
+
+	if(!step->lit || (disp->axis != SEGDISP_AXIS_SEGMENTS && ((disp->anim_blank >> step->digit) & 1))){
+		if(disp->keys_scan){
+			/* the digit stays enabled for its keys, with all the segments off */
+			disp->backend->phase(disp->backend->ctx, disp, 1UL << step->digit, disp->seg_invert);
+		}
+		else{
+			segdisp_blank(disp);
+		}
+	}
+	else if(disp->axis == SEGDISP_AXIS_SEGMENTS){
+		disp->backend->phase(disp->backend->ctx, disp, disp->axis_masks[step->digit] & disp->plane_digits[step->plane],
+			(1UL << step->digit) ^ disp->seg_invert);
+	}
+	else{
+		segdisp_show_digit(disp, step->digit, disp->shown[step->digit]);
+	}
+	if(disp->keys_scan){
+		disp->keys_digit = step->digit;
+	}
+
+#if SEGDISP_USE_STATS == TRUE
+	st->show_time += chSysGetRealtimeCounterX() - now;
+	__sync_synchronize();
+	disp->stats_seq++;
+#endif
+}
+
+/**
+ * Compiles the port words of one digit phase for the DMA streams [internal]
+ * @param disp     Display configuration structure
+ * @param position Position
+ */
+static void segdisp_dma_compile(segdisp_t *disp, int position){
+	ioportmask_t bits[SEGDISP_MAX_PORTS];
+	int i;
+
+	segdisp_phase_levels(disp, 1UL << position, disp->actual[position], bits);
+
+	for(i = 0; i < disp->ports_number; i++){
+		disp->dma_words[i * disp->digits->number + position] = SEGDISP_PORT_WORD(disp->ports[i].mask, bits[i]);
+	}
+}
+
+/**
+ * Rewrites the port words of the digits changed by the last update [internal]
+ * 
+ * Has to be called from the system locked state, the dirty cells are shared with the scroll timer.
+ * @param disp Display configuration structure
+ */
+static void segdisp_dma_update_i(segdisp_t *disp){
+	uint32_t bits;
+	int w;
+
+	for(w = 0; w < SEGDISP_DIRTY_WORDS(disp->digits->number); w++){
+		for(bits = disp->dirty[w]; bits != 0; bits &= bits - 1){
+			segdisp_dma_compile(disp, w * 32 + __builtin_ctz(bits));
+		}
+	}
+}
+
+/**
+ * Sets a character to the specified position of the back buffer [internal]
+ * 
+ * Caller has to hold display_buffer_mtx and begin the back buffer.
+ * @param disp     Display configuration structure
+ * @param position Position
+ * @param output   Ascii character to display
+ */
+static void segdisp_set_cell(segdisp_t *disp, int position, char output){
+	segdisp_fb_write(disp, position, disp->font[(uint8_t) output]);
+}
+
+/**
+ * Sets a character to the specified position that will be displayed [external API]
+ * @param  disp     Display configuration structure
+ * @param  position Position
+ * @param  output   Ascii character to display
+ * @return          Returns -1 on failure, 0 on success
+ */
+int segdisp_set(segdisp_t *disp, int position, char output){
+	if(position < 0 || position >= disp->digits->number)
+		return -1;
+
+	segdisp_writer_lock(disp);
+	segdisp_fb_begin(disp);
+	segdisp_set_cell(disp, position, output);
+	segdisp_fb_publish(disp);
+	chMtxUnlock(disp->display_buffer_mtx);
+
+	return 0;
+}
+
+/**
+ * Sets the output backend of the display [external API]
+ * 
+ * Call it before the refresh is started. segdisp_run_dma always drives the GPIO pins.
+ * @param  disp    Display configuration structure
+ * @param  backend Backend, e.g. segdisp_gpio_backend (default) or one made by segdisp_595_init
+ * @return         Returns -1 on failure, 0 on success
+ */
+int segdisp_set_backend(segdisp_t *disp, const segdisp_backend_t *backend){
+	if(backend == NULL || backend->phase == NULL || disp->refresh_mode != SEGDISP_REFRESH_STOPPED)
+		return -1;
+
+	disp->backend = backend;
+	disp->out_valid = false;
+	segdisp_blank(disp);
+
+	return 0;
+}
+
+/**
+ * Binds the character to output mapping table to the display [external API]
+ * 
+ * Call it before the refresh is started, the new mapping is used by the following segdisp_set calls.
+ * The stored codes were mapped by the old table, so the text and a pending mailbox update are
+ * dropped and the display is blank until the next update.
+ * @param  disp      Display configuration structure
+ * @param  font      Table with 256 entries indexed by (uint8_t) character, e.g. segdisp_font_7seg
+ * @param  polarized Nonzero if the table already has the segment polarity applied (see segdisp_font_polarize)
+ * @return           Returns -1 on failure, 0 on success
+ */
+int segdisp_set_font(segdisp_t *disp, const uint32_t *font, uint8_t polarized){
+	int ret = 0;
+	int i;
+
+	if(font == NULL || disp->refresh_mode != SEGDISP_REFRESH_STOPPED)
+		return -1;
+
+	segdisp_msg_lock(disp);
+	chMtxLock(disp->display_buffer_mtx);
+	disp->font = font;
+	disp->font_polarized = polarized;
+	if(segdisp_plan_build(disp) != 0){
+		ret = -1;
+	}
+
+	chSysLock();
+	for(i = 0; i < disp->digits->number; i++){
+		disp->actual[i] = font[' '];
+		disp->back[i] = font[' '];
+	}
+	disp->shown = disp->actual;
+	disp->swap_pending = false;
+	disp->mbox_fresh = false;
+	chSysUnlock();
+	disp->buffer_window = 0;
+	disp->offset = 0;
+	chMtxUnlock(disp->display_buffer_mtx);
+	segdisp_msg_unlock(disp);
+
+	segdisp_blank(disp);
+
+	return ret;
+}
+
+/**
+ * Creates variant of a font with the segment polarity of the display applied [external API]
+ * 
+ * Bits of the created table are directly the levels of the segment pins. Bind it with segdisp_set_font(disp, dst, 1).
+ * @param disp Display configuration structure
+ * @param dst  Table with 256 entries to fill
+ * @param src  Table with 256 entries with non-polarized output (bit set means segment on)
+ */
+void segdisp_font_polarize(segdisp_t *disp, uint32_t *dst, const uint32_t *src){
+	uint32_t invert = 0;
+	int i;
+
+	if((disp->flags & SEGDISP_DRIVER_FLAG) == SEGDISP_INVERTED_DRIVER){
+		invert = disp->seg_mask;
+	}
+
+	for(i = 0; i < 256; i++){
+		dst[i] = (src[i] & disp->seg_mask) ^ invert;
+	}
+}
+
+/**
+ * Locks the text for a writer [internal]
+ * 
+ * Scroll steps are not applied until segdisp_msg_unlock.
+ * @param disp Display configuration structure
+ */
+static void segdisp_msg_lock(segdisp_t *disp){
+	chMtxLock(disp->string_buffer_mtx);
+	chSysLock();
+	disp->msg_active = true;
+	chSysUnlock();
+}
+
+/**
+ * Unlocks the text locked by segdisp_msg_lock [internal]
+ * @param disp Display configuration structure
+ */
+static void segdisp_msg_unlock(segdisp_t *disp){
+	chSysLock();
+	disp->msg_active = false;
+	chSysUnlock();
+	chMtxUnlock(disp->string_buffer_mtx);
+}
+
+/**
+ * Redraws the display with the window of the text starting at current offset [internal]
+ * 
+ * The text is already encoded and padded, longer text wraps around.
+ * Caller has to hold string_buffer_mtx.
+ * @param disp Display configuration structure
+ */
+static void segdisp_render(segdisp_t *disp){
+	int pos = disp->offset;
+	int i;
+
+	segdisp_writer_lock(disp);
+	segdisp_fb_begin(disp);
+	for(i = 0; i < disp->digits->number; i++){
+		segdisp_fb_write(disp, i, disp->buffer[pos]);
+		if(++pos == disp->buffer_window){
+			pos = 0;
+		}
+	}
+	segdisp_fb_publish(disp);
+	chMtxUnlock(disp->display_buffer_mtx);
+}
+
+/**
+ * Move displayed text to the absolute position from the beginning [external API]
+ * @param  disp   Display configuration structure
+ * @param  offset Position to move the text to
+ * @return        Returns -1 on failure, 0 on success
+ */
+int segdisp_move_abs(segdisp_t *disp, int offset){
+	segdisp_msg_lock(disp);
+	if(disp->buffer_window == 0){
+		segdisp_msg_unlock(disp);
+		return -1;
+	}
+
+	disp->offset = utils_mod(offset, disp->buffer_window);
+	segdisp_render(disp);
+	segdisp_msg_unlock(disp);
+
+	return 0;
+}
+
+/**
+ * Move displayed text relatively to current position [external API]
+ * 
+ * The text itself is not modified, only the window into it is moved.
+ * @param  disp  Display configuration structure
+ * @param  step  Relative movement offset
+ * @return       Returns -1 on failure, 0 on success
+ */
+int segdisp_move_cont(segdisp_t *disp, int step){
+	segdisp_msg_lock(disp);
+	if(disp->buffer_window == 0){
+		segdisp_msg_unlock(disp);
+		return -1;
+	}
+
+	disp->offset = utils_mod(disp->offset + utils_mod(step, disp->buffer_window), disp->buffer_window);
+	segdisp_render(disp);
+#if SEGDISP_USE_STATS == TRUE
+	disp->stats_moves++;
+#endif
+	segdisp_msg_unlock(disp);
+
+	return 0;
+}
+
+/**
+ * Applies the scroll steps due to the front buffer [internal]
+ * 
+ * Nothing is done while the text or the back buffer is being written, the steps wait then.
+ * Has to be called with the system lock held.
+ * @param  disp Display configuration structure
+ * @return      Returns 1 if the text was moved, 0 otherwise
+ */
+static int segdisp_scroll_apply_i(segdisp_t *disp){
+	int pos;
+	int i;
+
+	if(disp->scroll_due == 0 || disp->msg_active || disp->writer_active || disp->buffer_window == 0)
+		return 0;
+
+	pos = utils_mod(disp->offset + utils_mod(disp->scroll_shift, disp->buffer_window), disp->buffer_window);
+	disp->offset = pos;
+#if SEGDISP_USE_STATS == TRUE
+	disp->stats_scrolled += disp->scroll_due;
+#endif
+	disp->scroll_due = 0;
+	disp->scroll_shift = 0;
+
+	memset(disp->dirty, 0, SEGDISP_DIRTY_WORDS(disp->digits->number) * sizeof(*disp->dirty));
+	for(i = 0; i < disp->digits->number; i++){
+		if(disp->actual[i] != disp->buffer[pos]){
+			disp->actual[i] = disp->buffer[pos];
+			disp->dirty[i >> 5] |= 1UL << (i & 31);
+		}
+		if(++pos == disp->buffer_window){
+			pos = 0;
+		}
+	}
+
+	return 1;
+}
+
+/* Scroll tick, the step is applied at the next frame boundary or here if there's none */
+static void segdisp_scroll_cb(void *arg){
+	segdisp_t *disp = (segdisp_t*)arg;
+
+	chSysLockFromISR();
+	if(!disp->scroll_running){
+		chSysUnlockFromISR();
+		return;
+	}
+	chVTSetI(&disp->scroll_timer, MS2ST(disp->scroll->delay), segdisp_scroll_cb, disp);
+	/* the step is taken now, segdisp_scroll_set may change it before the steps are applied */
+	disp->scroll_due++;
+	disp->scroll_shift += disp->scroll->step;
+	if(disp->refresh_mode == SEGDISP_REFRESH_STOPPED){
+		segdisp_scroll_apply_i(disp);
+	}
+	else if(disp->refresh_mode == SEGDISP_REFRESH_DMA && segdisp_scroll_apply_i(disp)){
+		segdisp_dma_update_i(disp);
+	}
+	else{
+		segdisp_wake_i(disp);
+	}
+	chSysUnlockFromISR();
+}
+
+/**
+ * Start the scrolling of the text. Scroll configuration structure has to be configured!
+ * 
+ * The text is moved by a virtual timer, no thread is created.
+ * @param  disp 	Display configuration structure
+ * @param  priority Not used, kept for compatibility
+ * @return     		Returns -1 on failure, 0 on success
+ */
+int segdisp_scroll_run(segdisp_t *disp, tprio_t priority){
+	(void) priority;
+
+	if(disp->scroll == NULL || disp->scroll->delay <= 0)
+		return -1;
+
+	chSysLock();
+	if(disp->scroll_running){
+		chSysUnlock();
+		return -1;
+	}
+	disp->scroll_running = true;
+	disp->scroll_due = 0;
+	disp->scroll_shift = 0;
+	chVTSetI(&disp->scroll_timer, MS2ST(disp->scroll->delay), segdisp_scroll_cb, disp);
+	chSysUnlock();
+
+	return 0;
+}
+
+/**
+ * Change speed and step of the scrolling [external API]
+ * 
+ * Changes the scroll configuration structure, the next step comes after the new delay.
+ * Steps that are already due but not applied yet move the text by the old step.
+ * @param  disp  Display configuration structure
+ * @param  delay Delay between steps (in ms)
+ * @param  step  Number of characters shifted in one step
+ * @return       Returns -1 on failure, 0 on success
+ */
+int segdisp_scroll_set(segdisp_t *disp, int delay, int step){
+	if(disp->scroll == NULL || delay <= 0)
+		return -1;
+
+	chSysLock();
+	disp->scroll->delay = delay;
+	disp->scroll->step = step;
+	if(disp->scroll_running){
+		chVTSetI(&disp->scroll_timer, MS2ST(delay), segdisp_scroll_cb, disp);
+	}
+	chSysUnlock();
+
+	return 0;
+}
+
+/**
+ * Stop the scrolling
+ * @param disp Display confguration structure
+ */
+void segdisp_scroll_stop(segdisp_t *disp){
+	chSysLock();
+	if(chVTIsArmedI(&disp->scroll_timer)){
+		chVTResetI(&disp->scroll_timer);
+	}
+	disp->scroll_running = false;
+	disp->scroll_due = 0;
+	disp->scroll_shift = 0;
+	chSysUnlock();
+}
+
+/**
+ * Run the display refresh
+ * @param  disp     Display configuration structure
+ * @param  priority Priority of the refreshing thread
+ * @return          Returns -1 on failure, 0 on success
+ */
+int segdisp_run(segdisp_t *disp, tprio_t priority){
+	if(segdisp_refresh_start(disp, SEGDISP_REFRESH_THREAD) != 0)
+		return -1;
+
+	if(disp->wa != NULL){
+		disp->thread = chThdCreateStatic(disp->wa, disp->wa_size, priority, segdisp_refresh_thread, disp);
+	}
+	else{
+		disp->thread = chThdCreateFromHeap(NULL, THD_WORKING_AREA_SIZE(SEGDISP_REFRESH_WA_SIZE), priority,
+			segdisp_refresh_thread, disp);
+	}
+	if(disp->thread == NULL){
+		disp->refresh_mode = SEGDISP_REFRESH_STOPPED;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Run the display refresh driven by a virtual timer, without any thread
+ * 
+ * Each step of the multiplex is done from the timer callback in ISR context,
+ * so every digit is lit for the same number of system ticks.
+ * @param  disp Display configuration structure
+ * @return      Returns -1 on failure, 0 on success
+ */
+int segdisp_run_timer(segdisp_t *disp){
+	if(segdisp_refresh_start(disp, SEGDISP_REFRESH_TIMER) != 0)
+		return -1;
+
+	chSysLock();
+	chVTSetI(&disp->timer, 1, segdisp_timer_cb, disp);
+	chSysUnlock();
+
+	return 0;
+}
+
+/**
+ * Run the display refresh by streaming precompiled port words, without any CPU work per digit
+ * 
+ * The whole frame is compiled into words array with one word per digit phase for each port,
+ * words of port i are at words[i * digits->number]. The backend streams them circularly to the ports,
+ * e.g. by timer triggered DMA to the BSRR registers. Updates rewrite only the words of the changed digits.
+ * @param  disp    Display configuration structure
+ * @param  backend Backend streaming the words to the ports
+ * @param  words   Buffer of SEGDISP_DMA_WORDS(ports_number, digits->number) words, it has to be accessible by the DMA
+ * @return         Returns -1 on failure, 0 on success
+ */
+int segdisp_run_dma(segdisp_t *disp, const segdisp_dma_backend_t *backend, uint32_t *words){
+	int i;
+
+	if(disp->thread != NULL || disp->refresh_mode != SEGDISP_REFRESH_STOPPED)
+		return -1;
+	if(backend == NULL || words == NULL || disp->ports_number == 0)
+		return -1;
+
+	/* the words have 16 set and 16 reset bits */
+	for(i = 0; i < disp->ports_number; i++){
+		if((disp->ports[i].mask & ~(ioportmask_t) 0xFFFF) != 0)
+			return -1;
+	}
+
+	chMtxLock(disp->display_buffer_mtx);
+	disp->dma = backend;
+	disp->dma_words = words;
+	/* a scroll step between the compile and the mode change would be lost */
+	chSysLock();
+	if(disp->brightness_pending){
+		disp->brightness_pending = false;
+		segdisp_brightness_update_i(disp);
+	}
+	segdisp_fb_swap_i(disp);
+	for(i = 0; i < disp->digits->number; i++){
+		segdisp_dma_compile(disp, i);
+	}
+	disp->refresh_mode = SEGDISP_REFRESH_DMA;
+	chSysUnlock();
+	chMtxUnlock(disp->display_buffer_mtx);
+
+	for(i = 0; i < disp->ports_number; i++){
+		if(backend->start(backend->ctx, i, disp->ports[i].port, &words[i * disp->digits->number], disp->digits->number, disp->refresh) != 0){
+			segdisp_stop(disp);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Stop display refresh
+ * 
+ * The text is dropped, a message buffer allocated by segdisp_set_str is returned to the heap,
+ * and the scrolling is stopped.
+ * @param disp Display configuration structure
+ */
+void segdisp_stop(segdisp_t *disp){
+	/* an armed scroll timer would be linked twice by the next segdisp_init */
+	segdisp_scroll_stop(disp);
+	segdisp_set_str(disp, " ");
+	segdisp_anim_stop(disp);
+
+	if(disp->refresh_mode == SEGDISP_REFRESH_TIMER){
+		chSysLock();
+		if(chVTIsArmedI(&disp->timer)){
+			chVTResetI(&disp->timer);
+		}
+		disp->refresh_mode = SEGDISP_REFRESH_STOPPED;
+		chSysUnlock();
+		segdisp_blank(disp);
+	}
+	else if(disp->refresh_mode == SEGDISP_REFRESH_THREAD){
+		/* the thread ends at the frame boundary, its working area is free then; the mode stays
+		 * until it's gone, the scroll timer would step the text by itself in the stopped mode */
+		chThdTerminate(disp->thread);
+		chSysLock();
+		segdisp_wake_i(disp);
+		chSchRescheduleS();
+		chSysUnlock();
+		chThdWait(disp->thread);
+		disp->thread = NULL;
+		chSysLock();
+		disp->refresh_mode = SEGDISP_REFRESH_STOPPED;
+		chSysUnlock();
+	}
+	else if(disp->refresh_mode == SEGDISP_REFRESH_MANAGED){
+		/* the manager skips stopped displays, it checks the mode and steps the display holding its mutex */
+		chMtxLock(disp->mgr_mtx);
+		disp->refresh_mode = SEGDISP_REFRESH_STOPPED;
+		segdisp_blank(disp);
+		chMtxUnlock(disp->mgr_mtx);
+	}
+	else if(disp->refresh_mode == SEGDISP_REFRESH_DMA){
+		disp->dma->stop(disp->dma->ctx);
+		chMtxLock(disp->display_buffer_mtx);
+		disp->refresh_mode = SEGDISP_REFRESH_STOPPED;
+		chMtxUnlock(disp->display_buffer_mtx);
+		/* the streams left the ports in the levels of some phase */
+		disp->out_valid = false;
+		segdisp_blank(disp);
+	}
+
+	/* nothing of the display stays on the heap, it can be initialized again */
+	segdisp_msg_lock(disp);
+	if(disp->buffer_owned){
+		chHeapFree(disp->buffer);
+		disp->buffer = NULL;
+		disp->buffer_size = 0;
+		disp->buffer_owned = false;
+		disp->buffer_window = 0;
+		disp->offset = 0;
+	}
+	segdisp_msg_unlock(disp);
+}
+
+#if SEGDISP_USE_STATS == TRUE
+/**
+ * Get the refresh statistics [external API]
+ * 
+ * Can be called from any thread while the refresh is running, the refresh is never blocked by it.
+ * It may sleep while a refresh step is in progress and it locks the mutexes of the display,
+ * so it must not be called from an ISR, a virtual timer callback or with the system locked.
+ * @param disp  Display configuration structure
+ * @param stats Structure to copy the statistics to
+ */
+void segdisp_stats_get(segdisp_t *disp, segdisp_stats_t *stats){
+	uint32_t seq;
+
+	/* refresh part, retried when the refresh updated it meanwhile; an odd sequence means
+	 * the caller preempted the refresh in the middle of a step, so it sleeps to let the
+	 * refresh finish instead of spinning above its priority */
+	for(;;){
+		seq = disp->stats_seq;
+		if((seq & 1) != 0){
+			chThdSleep(1);
+			continue;
+		}
+		__sync_synchronize();
+		memcpy(stats, (const void *) &disp->stats, sizeof(*stats));
+		__sync_synchronize();
+		if(seq == disp->stats_seq)
 			break;
+	}
+
+	/* writers part */
+	chMtxLock(disp->display_buffer_mtx);
+	stats->lock_blocked = disp->stats_lock_blocked;
+	stats->lock_wait = disp->stats_lock_wait;
+	stats->lock_wait_max = disp->stats_lock_wait_max;
+	chMtxUnlock(disp->display_buffer_mtx);
+	chMtxLock(disp->string_buffer_mtx);
+	stats->scroll_steps = disp->stats_moves;
+	chMtxUnlock(disp->string_buffer_mtx);
+	chSysLock();
+	stats->scroll_steps += disp->stats_scrolled;
+	chSysUnlock();
+}
+#endif
+
+/**
+ * Set string to display
+ * 
+ * The string is encoded by the current font to the message buffer once, scrolling then
+ * only copies the codes. The string doesn't have to stay valid after the call.
+ * @param  disp Display configuration structure
+ * @param  text Pointer to the string to display
+ * @return      Returns -1 on failure (also if the message buffer is too small), 0 on success
+ */
+int segdisp_set_str(segdisp_t *disp, const char *text){
+	int window;
+	int len;
+	int i;
+
+	if(text == NULL)
+		return -1;
+	len = strlen(text);
+	if(len < 1)
+		return -1;
+	window = SEGDISP_MSG_WORDS(len, disp->digits->number);
+
+	segdisp_msg_lock(disp);
+	if(window > disp->buffer_size){
+		if(disp->buffer != NULL && !disp->buffer_owned){
+			segdisp_msg_unlock(disp);
+			return -1;
+		}
+		if(disp->buffer_owned){
+			chHeapFree(disp->buffer);
+		}
+		disp->buffer = chHeapAlloc(NULL, window * sizeof(*disp->buffer));
+		disp->buffer_owned = disp->buffer != NULL;
+		disp->buffer_size = disp->buffer != NULL ? window : 0;
+		if(disp->buffer == NULL){
+			disp->buffer_window = 0;
+			segdisp_msg_unlock(disp);
+			return -1;
+		}
+	}
+
+	for(i = 0; i < len; i++){
+		disp->buffer[i] = disp->font[(uint8_t) text[i]];
+	}
+	for(; i < window; i++){
+		disp->buffer[i] = disp->font[' '];
+	}
+	disp->buffer_window = window;
+	disp->offset = 0;
+	segdisp_render(disp);
+	segdisp_msg_unlock(disp);
+
+	return 0;
+}
+
+/**
+ * Sets the buffer the texts are encoded to [external API]
+ * 
+ * Without it, the buffer is allocated from the default heap by segdisp_set_str. The current
+ * text is dropped, the displayed content stays until the next segdisp_set_str.
+ * @param disp   Display configuration structure
+ * @param buffer Buffer for SEGDISP_MSG_WORDS(longest text, digits) words, NULL to use the heap again
+ * @param size   Size of the buffer in words
+ */
+void segdisp_set_msg_buffer(segdisp_t *disp, uint32_t *buffer, int size){
+	segdisp_msg_lock(disp);
+	if(disp->buffer_owned){
+		chHeapFree(disp->buffer);
+	}
+	disp->buffer = buffer;
+	disp->buffer_size = buffer != NULL ? size : 0;
+	disp->buffer_owned = false;
+	disp->buffer_window = 0;
+	disp->offset = 0;
+	segdisp_msg_unlock(disp);
+}
+
+/**
+ * Lights the segments of both output values [internal]
+ * @param  disp Display configuration structure
+ * @param  a    Output value
+ * @param  b    Output value
+ * @return      Output value with the segments lit in any of them
+ */
+static inline uint32_t segdisp_merge(segdisp_t *disp, uint32_t a, uint32_t b){
+	return ((a ^ disp->seg_invert) | (b ^ disp->seg_invert)) ^ disp->seg_invert;
+}
+
+/**
+ * Converts a number to output values of all the digits [internal]
+ * 
+ * The decimal point is merged to the digit before the decimals.
+ * @param  disp      Display configuration structure
+ * @param  out       Output values of the digits
+ * @param  magnitude Absolute value of the number
+ * @param  negative  Nonzero if the number is negative
+ * @param  base      Base of the number, 10 or 16
+ * @param  decimals  Number of digits after the decimal point
+ * @param  flags     SEGDISP_NUM_LEFT and SEGDISP_NUM_ZEROS
+ * @return           Returns 1 if the number doesn't fit (dashes are shown), 0 otherwise
+ */
+static int segdisp_format(segdisp_t *disp, uint32_t *out, uint32_t magnitude, int negative, int base, int decimals,
+	uint8_t flags){
+	static const char symbols[] = "0123456789ABCDEF";
+	uint32_t rest;
+	int len = 1;
+	int width;
+	int pos;
+	int i;
+
+	for(rest = magnitude; rest >= (uint32_t) base; rest /= base){
+		len++;
+	}
+	if(len < decimals + 1){
+		len = decimals + 1;
+	}
+
+	if(len + negative > disp->digits->number){
+		for(i = 0; i < disp->digits->number; i++){
+			out[i] = disp->font['-'];
+		}
+		return 1;
+	}
+
+	width = (flags & SEGDISP_NUM_ZEROS) != 0 ? disp->digits->number : len + negative;
+	for(i = 0; i < disp->digits->number; i++){
+		out[i] = disp->font[' '];
+	}
+
+	pos = (flags & SEGDISP_NUM_LEFT) != 0 ? width : disp->digits->number;
+	for(i = 0; i < width - negative; i++){
+		out[--pos] = disp->font[(uint8_t) symbols[magnitude % base]];
+		magnitude /= base;
+		if(decimals > 0 && i == decimals){
+			out[pos] = segdisp_merge(disp, out[pos], disp->font['.']);
+		}
+	}
+	if(negative){
+		out[--pos] = disp->font['-'];
+	}
+
+	return 0;
+}
+
+/**
+ * Replaces the text by output values of all the digits [internal]
+ * @param disp  Display configuration structure
+ * @param codes Output values
+ */
+static void segdisp_set_codes(segdisp_t *disp, const uint32_t *codes){
+	int i;
+
+	segdisp_msg_lock(disp);
+	disp->buffer_window = 0;
+	disp->offset = 0;
+	segdisp_writer_lock(disp);
+	segdisp_fb_begin(disp);
+	for(i = 0; i < disp->digits->number; i++){
+		segdisp_fb_write(disp, i, codes[i]);
+	}
+	segdisp_fb_publish(disp);
+	chMtxUnlock(disp->display_buffer_mtx);
+	segdisp_msg_unlock(disp);
+}
+
+/**
+ * Show integer number [external API]
+ * 
+ * The number is converted directly to the output values, it replaces the displayed text.
+ * @param  disp  Display configuration structure
+ * @param  value Number to show
+ * @param  flags SEGDISP_NUM_LEFT to align the number to the left, SEGDISP_NUM_ZEROS to pad it by zeros
+ * @return       Returns -1 on failure, 1 if the number doesn't fit (dashes are shown), 0 on success
+ */
+int segdisp_set_int(segdisp_t *disp, int32_t value, uint8_t flags){
+	return segdisp_set_fixed(disp, value, 0, flags);
+}
+
+/**
+ * Show fixed point number [external API]
+ * 
+ * E.g. value 1234 with 2 decimals is shown as 12.34, the decimal point doesn't take a digit.
+ * @param  disp     Display configuration structure
+ * @param  value    Number to show multiplied by 10^decimals
+ * @param  decimals Number of digits after the decimal point
+ * @param  flags    SEGDISP_NUM_LEFT to align the number to the left, SEGDISP_NUM_ZEROS to pad it by zeros
+ * @return          Returns -1 on failure, 1 if the number doesn't fit (dashes are shown), 0 on success
+ */
+int segdisp_set_fixed(segdisp_t *disp, int32_t value, int decimals, uint8_t flags){
+	uint32_t codes[SEGDISP_MAX_DIGITS];
+	int ret;
+
+	if(decimals < 0 || decimals >= disp->digits->number)
+		return -1;
+
+	ret = segdisp_format(disp, codes, value < 0 ? -(uint32_t) value : (uint32_t) value, value < 0, 10, decimals, flags);
+	segdisp_set_codes(disp, codes);
+
+	return ret;
+}
+
+/**
+ * Show hexadecimal number [external API]
+ * @param  disp  Display configuration structure
+ * @param  value Number to show
+ * @param  flags SEGDISP_NUM_LEFT to align the number to the left, SEGDISP_NUM_ZEROS to pad it by zeros
+ * @return       Returns -1 on failure, 1 if the number doesn't fit (dashes are shown), 0 on success
+ */
+int segdisp_set_hex(segdisp_t *disp, uint32_t value, uint8_t flags){
+	uint32_t codes[SEGDISP_MAX_DIGITS];
+	int ret;
+
+	ret = segdisp_format(disp, codes, value, 0, 16, 0, flags);
+	segdisp_set_codes(disp, codes);
+
+	return ret;
+}
+
+/**
+ * Sets the storage of the update mailbox [external API]
+ * 
+ * The mailbox lets one producer, e.g. an interrupt handler, update the display without locking
+ * a mutex. Updates are applied at the frame boundary, faster updates overwrite the older ones.
+ * Call it before the refresh is started.
+ * @param  disp    Display configuration structure
+ * @param  storage Buffer of SEGDISP_MBOX_WORDS(digits) words
+ * @return         Returns -1 on failure, 0 on success
+ */
+int segdisp_mbox_init(segdisp_t *disp, uint32_t *storage){
+	if(storage == NULL)
+		return -1;
+
+	chSysLock();
+	disp->mbox = storage;
+	disp->mbox_write = 0;
+	disp->mbox_ready = 1;
+	disp->mbox_read = 2;
+	disp->mbox_fresh = false;
+	chSysUnlock();
+
+	return 0;
+}
+
+/**
+ * Hands the slot filled by the producer over to the consumer [internal]
+ * @param disp Display configuration structure
+ */
+static void segdisp_mbox_post(segdisp_t *disp){
+	syssts_t sts;
+	uint8_t slot;
+
+	sts = chSysGetStatusAndLockX();
+	slot = disp->mbox_ready;
+	disp->mbox_ready = disp->mbox_write;
+	disp->mbox_write = slot;
+	disp->mbox_fresh = true;
+	disp->mbox_posts++;
+	segdisp_wake_i(disp);
+	chSysRestoreStatusX(sts);
+}
+
+/**
+ * Encodes the beginning of the string padded by spaces to the width of the display [internal]
+ * @param disp Display configuration structure
+ * @param out  Output values of the digits
+ * @param text String to encode
+ */
+static void segdisp_encode(segdisp_t *disp, uint32_t *out, const char *text){
+	int i;
+
+	for(i = 0; i < disp->digits->number && text[i] != '\0'; i++){
+		out[i] = disp->font[(uint8_t) text[i]];
+	}
+	for(; i < disp->digits->number; i++){
+		out[i] = disp->font[' '];
+	}
+}
+
+/**
+ * Post output codes to the mailbox [external API]
+ * 
+ * Can be called from any context including interrupt handlers, from a single producer only.
+ * @param  disp   Display configuration structure
+ * @param  codes  Output values (e.g. from the font) of the digits from the left
+ * @param  number Number of the values, remaining digits are blank
+ * @return        Returns -1 on failure, 0 on success
+ */
+int segdisp_post_codes(segdisp_t *disp, const uint32_t *codes, int number){
+	uint32_t *slot;
+	int i;
+
+	if(disp->mbox == NULL || codes == NULL)
+		return -1;
+
+	slot = disp->mbox + disp->mbox_write * disp->digits->number;
+	for(i = 0; i < disp->digits->number; i++){
+		slot[i] = i < number ? codes[i] : disp->font[' '];
+	}
+	segdisp_mbox_post(disp);
+
+	return 0;
+}
+
+/**
+ * Post string to the mailbox [external API]
+ * 
+ * Shows the beginning of the string padded by spaces, the scrolled text is not changed.
+ * Can be called from any context including interrupt handlers, from a single producer only.
+ * @param  disp Display configuration structure
+ * @param  text String to show
+ * @return      Returns -1 on failure, 0 on success
+ */
+int segdisp_post_str(segdisp_t *disp, const char *text){
+	if(disp->mbox == NULL || text == NULL)
+		return -1;
+
+	segdisp_encode(disp, disp->mbox + disp->mbox_write * disp->digits->number, text);
+	segdisp_mbox_post(disp);
+
+	return 0;
+}
+
+/**
+ * Post number to the mailbox [external API]
+ * 
+ * The number is aligned to the right, number that doesn't fit is shown as dashes.
+ * Can be called from any context including interrupt handlers, from a single producer only.
+ * @param  disp  Display configuration structure
+ * @param  value Number to show
+ * @return       Returns -1 on failure, 0 on success
+ */
+int segdisp_post_int(segdisp_t *disp, int32_t value){
+	if(disp->mbox == NULL)
+		return -1;
+
+	segdisp_format(disp, disp->mbox + disp->mbox_write * disp->digits->number,
+		value < 0 ? -(uint32_t) value : (uint32_t) value, value < 0, 10, 0, 0);
+	segdisp_mbox_post(disp);
+
+	return 0;
+}
+
+/**
+ * Apply the update posted to the mailbox [external API]
+ * 
+ * The thread, timer and managed refresh apply the updates by themselves. With segdisp_run_dma
+ * or without refresh, call it from a thread when the posted content should be shown.
+ * @param disp Display configuration structure
+ */
+void segdisp_mbox_apply(segdisp_t *disp){
+	int applied;
+	int i;
+
+	if(disp->refresh_mode != SEGDISP_REFRESH_STOPPED && disp->refresh_mode != SEGDISP_REFRESH_DMA)
+		return;
+
+	chMtxLock(disp->display_buffer_mtx);
+	chSysLock();
+	applied = segdisp_mbox_apply_i(disp);
+	if(applied && disp->refresh_mode == SEGDISP_REFRESH_DMA){
+		for(i = 0; i < disp->digits->number; i++){
+			segdisp_dma_compile(disp, i);
+		}
+	}
+	chSysUnlock();
+	chMtxUnlock(disp->display_buffer_mtx);
+}
+
+/* Animations */
 
-		case ' ':
-		default: 
-			out = 0;
-		break;
+/**
+ * Advances the playing animation, called at the frame boundary from the system locked state [internal]
+ * @param disp Display configuration structure
+ */
+static void segdisp_anim_step_i(segdisp_t *disp){
+	const segdisp_anim_frame_t *frame;
+	systime_t now;
+	uint8_t level = SEGDISP_BRIGHTNESS_MAX;
+
+	if(disp->anim != NULL){
+		now = chVTGetSystemTimeX();
+		if(disp->anim_frame < 0){
+			disp->anim_frame = 0;
+			disp->anim_loops = 0;
+			disp->anim_start = now;
+		}
+		/* frames shorter than the refresh frame are skipped */
+		while(disp->anim != NULL && (systime_t) (now - disp->anim_start) >= disp->anim[disp->anim_frame].ticks){
+			disp->anim_start += disp->anim[disp->anim_frame].ticks;
+			if(++disp->anim_frame < disp->anim_number)
+				continue;
+			disp->anim_frame = 0;
+			if(disp->anim_repeat != 0 && ++disp->anim_loops == disp->anim_repeat){
+				disp->anim = NULL;
+				chEvtBroadcastI(&disp->anim_event);
+			}
+		}
+	}
+
+	if(disp->anim != NULL){
+		frame = &disp->anim[disp->anim_frame];
+		disp->shown = frame->codes != NULL ? frame->codes : disp->actual;
+		disp->anim_blank = frame->blank;
+		level = frame->level;
+	}
+	else{
+		disp->shown = disp->actual;
+		disp->anim_blank = 0;
+	}
+	if(level != disp->anim_level){
+		disp->anim_level = level;
+		segdisp_brightness_update_i(disp);
+	}
+}
+
+/**
+ * Play an animation [external API]
+ * 
+ * The refresh steps through the frames by itself at the frame boundaries, so the frame durations
+ * are rounded to the refresh frames. The animation covers the content of the display, which is
+ * updated as usual meanwhile and shown again when the animation finishes or is stopped.
+ * When the last play finishes, anim_event is broadcast. Frames have to stay valid while the animation plays.
+ * Works with the thread, timer and managed refresh.
+ * @param  disp   Display configuration structure
+ * @param  frames Frames of the animation
+ * @param  number Number of the frames
+ * @param  repeat Number of plays, 0 to repeat the animation until segdisp_anim_stop
+ * @return        Returns -1 on failure, 0 on success
+ */
+int segdisp_anim_play(segdisp_t *disp, const segdisp_anim_frame_t *frames, int number, int repeat){
+	int i;
+
+	if(frames == NULL || number <= 0 || repeat < 0)
+		return -1;
+	if(disp->refresh_mode != SEGDISP_REFRESH_THREAD && disp->refresh_mode != SEGDISP_REFRESH_TIMER &&
+		disp->refresh_mode != SEGDISP_REFRESH_MANAGED)
+		return -1;
+	for(i = 0; i < number; i++){
+		if(frames[i].ticks == 0 || frames[i].level > SEGDISP_BRIGHTNESS_MAX)
+			return -1;
+	}
+
+	chSysLock();
+	disp->anim = frames;
+	disp->anim_number = number;
+	disp->anim_repeat = repeat;
+	disp->anim_frame = -1;
+	segdisp_wake_i(disp);
+	chSchRescheduleS();
+	chSysUnlock();
+
+	return 0;
+}
+
+/**
+ * Stop the animation, the content of the display is shown from the next frame [external API]
+ * @param disp Display configuration structure
+ */
+void segdisp_anim_stop(segdisp_t *disp){
+	chSysLock();
+	disp->anim = NULL;
+	chSysUnlock();
+}
+
+/**
+ * Build blinking of the current content [external API]
+ * @param  frames Two frames to fill
+ * @param  mask   Digits to blink, bit 0 is the digit 0
+ * @param  on     Time the digits are on (in ms)
+ * @param  off    Time the digits are off (in ms)
+ * @return        Returns -1 on failure, number of the frames on success
+ */
+int segdisp_anim_blink(segdisp_anim_frame_t *frames, uint32_t mask, int on, int off){
+	if(frames == NULL || on <= 0 || off <= 0)
+		return -1;
+
+	frames[0].codes = NULL;
+	frames[0].blank = 0;
+	frames[0].level = SEGDISP_BRIGHTNESS_MAX;
+	frames[0].ticks = MS2ST(on);
+	frames[1].codes = NULL;
+	frames[1].blank = mask;
+	frames[1].level = SEGDISP_BRIGHTNESS_MAX;
+	frames[1].ticks = MS2ST(off);
+
+	return 2;
+}
+
+/**
+ * Build fading of the current content from one brightness level to another [external API]
+ * @param  frames   Frames to fill, one per step
+ * @param  steps    Number of the steps
+ * @param  from     First brightness level
+ * @param  to       Last brightness level
+ * @param  duration Duration of the fade (in ms)
+ * @return          Returns -1 on failure, number of the frames on success
+ */
+int segdisp_anim_fade(segdisp_anim_frame_t *frames, int steps, uint8_t from, uint8_t to, int duration){
+	systime_t ticks = MS2ST(duration) / (steps > 0 ? steps : 1);
+	int i;
+
+	if(frames == NULL || steps <= 0 || duration <= 0 || from > SEGDISP_BRIGHTNESS_MAX || to > SEGDISP_BRIGHTNESS_MAX)
+		return -1;
+
+	for(i = 0; i < steps; i++){
+		frames[i].codes = NULL;
+		frames[i].blank = 0;
+		frames[i].level = steps > 1 ? from + (to - from) * i / (steps - 1) : to;
+		frames[i].ticks = ticks != 0 ? ticks : 1;
+	}
+
+	return steps;
+}
+
+/**
+ * Build a frame showing the given text, e.g. to alternate messages [external API]
+ * @param  disp     Display configuration structure
+ * @param  frame    Frame to fill
+ * @param  codes    Storage of the output values, one word per digit
+ * @param  text     Text of the frame, the beginning is shown padded by spaces
+ * @param  duration Duration of the frame (in ms)
+ * @return          Returns -1 on failure, number of the frames on success
+ */
+int segdisp_anim_text(segdisp_t *disp, segdisp_anim_frame_t *frame, uint32_t *codes, const char *text, int duration){
+	if(frame == NULL || codes == NULL || text == NULL || duration <= 0)
+		return -1;
+
+	segdisp_encode(disp, codes, text);
+	frame->codes = codes;
+	frame->blank = 0;
+	frame->level = SEGDISP_BRIGHTNESS_MAX;
+	frame->ticks = MS2ST(duration);
+
+	return 1;
+}
+
+/**
+ * Build a wipe from the current content to the given text [external API]
+ * 
+ * The current content is wiped out digit by digit from the left and then the text is wiped in.
+ * Set the text to the display after starting the animation, it is shown when the animation finishes.
+ * @param  disp     Display configuration structure
+ * @param  frames   SEGDISP_ANIM_WIPE_FRAMES(digits) frames to fill
+ * @param  codes    Storage of the output values, two words per digit
+ * @param  text     Text to wipe in
+ * @param  duration Duration of the wipe (in ms)
+ * @return          Returns -1 on failure, number of the frames on success
+ */
+int segdisp_anim_wipe(segdisp_t *disp, segdisp_anim_frame_t *frames, uint32_t *codes, const char *text, int duration){
+	int number = disp->digits->number;
+	systime_t ticks = MS2ST(duration) / (2 * number);
+	uint32_t all = 0xFFFFFFFF >> (SEGDISP_MAX_DIGITS - number);
+	uint32_t mask = 0;
+	int i;
+
+	if(frames == NULL || codes == NULL || text == NULL || duration <= 0)
+		return -1;
+
+	chSysLock();
+	memcpy(codes, disp->actual, number * sizeof(*codes));
+	chSysUnlock();
+	segdisp_encode(disp, codes + number, text);
+
+	for(i = 0; i < number; i++){
+		mask = (mask << 1) | 1;
+		frames[i].codes = codes;
+		frames[i].blank = mask;
+		frames[number + i].codes = codes + number;
+		frames[number + i].blank = all & ~mask;
+	}
+	for(i = 0; i < 2 * number; i++){
+		frames[i].level = SEGDISP_BRIGHTNESS_MAX;
+		frames[i].ticks = ticks != 0 ? ticks : 1;
+	}
+
+	return 2 * number;
+}
+
+/**
+ * Reads the return lines of the digit enabled by the last step and debounces its keys [internal]
+ * 
+ * A new state of the keys of the digit is reported when it was read in debounce frames in a row.
+ * Has to be called from the system locked state, before the next digit is enabled.
+ * @param disp Display configuration structure
+ */
+static void segdisp_keys_sample_i(segdisp_t *disp){
+	const segdisp_keys_conf_t *conf = disp->keys;
+	int digit = disp->keys_digit;
+	ioportmask_t levels;
+	eventflags_t flags = 0;
+	uint32_t changed;
+	uint32_t row = 0;
+	int pressed;
+	int j;
+
+	if(digit < 0)
+		return;
+	disp->keys_digit = -1;
+
+	levels = palReadPort(disp->keys_port);
+	for(j = 0; j < conf->returns->number; j++){
+		if(((levels >> conf->returns->pins[j].pin) & 1) == conf->active){
+			row |= 1UL << j;
+		}
+	}
+
+	if(row == disp->keys_state[digit]){
+		disp->keys_count[digit] = 0;
+		return;
+	}
+	if(row != disp->keys_pending[digit]){
+		disp->keys_pending[digit] = row;
+		disp->keys_count[digit] = 0;
 	}
+	if(++disp->keys_count[digit] < conf->debounce)
+		return;
+
+	changed = row ^ disp->keys_state[digit];
+	disp->keys_state[digit] = row;
+	disp->keys_count[digit] = 0;
+	for(; changed != 0; changed &= changed - 1){
+		j = __builtin_ctz(changed);
+		pressed = (row >> j) & 1;
+		flags |= pressed ? SEGDISP_KEYS_PRESSED : SEGDISP_KEYS_RELEASED;
+		if(conf->mbox != NULL && chMBPostI(conf->mbox, SEGDISP_KEY_MSG(digit * conf->returns->number + j, pressed)) != MSG_OK){
+			disp->keys_lost++;
+		}
+	}
+	chEvtBroadcastFlagsI(&disp->keys_event, flags);
+}
+
+/**
+ * Set up scanning of keys wired between the digit lines and return lines [external API]
+ * 
+ * The key on the return line j of the digit i has index i * returns->number + j.
+ * The thread and timer refresh read the return port once per digit phase, before the next digit is enabled,
+ * and report the debounced changes by keys_event and by SEGDISP_KEY_MSG messages to the mailbox of the configuration.
+ * Every digit is enabled in every frame then, dark digits with all the segments off and SEGDISP_BLANK_SKIPPED is ignored.
+ * Only displays multiplexed by digits can scan keys. Call it before the refresh is started.
+ * @param  disp    Display configuration structure
+ * @param  conf    Key scanning configuration, it has to stay valid
+ * @param  storage Storage of SEGDISP_KEYS_WORDS(digits) words
+ * @return         Returns -1 on failure, 0 on success
+ */
+int segdisp_keys_init(segdisp_t *disp, const segdisp_keys_conf_t *conf, uint32_t *storage){
+	int i;
+
+	if(conf == NULL || storage == NULL || conf->returns == NULL || conf->returns->number <= 0 ||
+		conf->returns->number > SEGDISP_MAX_SEGMENTS)
+		return -1;
+	if(disp->axis != SEGDISP_AXIS_DIGITS || disp->refresh_mode != SEGDISP_REFRESH_STOPPED)
+		return -1;
+	for(i = 0; i < conf->returns->number; i++){
+		if(conf->returns->pins[i].port == NULL || conf->returns->pins[i].port != conf->returns->pins[0].port)
+			return -1;
+	}
+
+	for(i = 0; i < conf->returns->number; i++){
+		palSetPadMode((ioportid_t) conf->returns->pins[i].port, conf->returns->pins[i].pin,
+			conf->active == PAL_LOW ? PAL_MODE_INPUT_PULLUP : PAL_MODE_INPUT_PULLDOWN);
+	}
+	memset(storage, 0, SEGDISP_KEYS_WORDS(disp->digits->number) * sizeof(*storage));
+	disp->keys_state = storage;
+	disp->keys_pending = storage + disp->digits->number;
+	disp->keys_count = storage + 2 * disp->digits->number;
+	disp->keys_port = (ioportid_t) conf->returns->pins[0].port;
+	disp->keys = conf;
+
+	return 0;
+}
+
+/**
+ * Get the debounced state of a key [external API]
+ * @param  disp Display configuration structure
+ * @param  key  Index of the key
+ * @return      Returns -1 on failure, 1 if the key is pressed, 0 otherwise
+ */
+int segdisp_key_pressed(segdisp_t *disp, int key){
+	int returns;
+
+	if(disp->keys == NULL || key < 0)
+		return -1;
+	returns = disp->keys->returns->number;
+	if(key >= disp->digits->number * returns)
+		return -1;
+
+	return (disp->keys_state[key / returns] >> (key % returns)) & 1;
+}
+
+/**
+ * Character to output mapping for 7 segment display, indexed by (uint8_t) character.
+ * Each bit represents one segment, '.' is the decimal point (bit 7), characters without a glyph are shown as the lower square.
+ */
+const uint32_t segdisp_font_7seg[256] = {
+	[0x00 ... ' ' - 1] = 0b0011100,
+	[' '] = 0,
+	['!' ... ','] = 0b0011100,
+	['-'] = 0b1000000,
+	['.'] = 0b10000000,
+	['/'] = 0b0011100,
+	['0'] = 0b0111111,
+	['1'] = 0b0000110,
+	['2'] = 0b1011011,
+	['3'] = 0b1001111,
+	['4'] = 0b1100110,
+	['5'] = 0b1101101,
+	['6'] = 0b1111101,
+	['7'] = 0b0000111,
+	['8'] = 0b1111111,
+	['9'] = 0b1101111,
+	[':' ... '@'] = 0b0011100,
+	['A'] = 0b1110111,
+	['B'] = 0b1111100,
+	['C'] = 0b0111001,
+	['D'] = 0b1011110,
+	['E'] = 0b1111001,
+	['F'] = 0b1110001,
+	['G' ... '`'] = 0b0011100,
+	['a'] = 0b1110111,
+	['b'] = 0b1111100,
+	['c'] = 0b0111001,
+	['d'] = 0b1011110,
+	['e'] = 0b1111001,
+	['f'] = 0b1110001,
+	['g' ... 0xFF] = 0b0011100
+};
+
+/**
+ * Character to output mapping for 16 segment display, indexed by (uint8_t) character.
+ * Each bit represents one segment, characters without a glyph are blank.
+ */
+const uint32_t segdisp_font_16seg[256] = {
+	['A'] = 0b0000001111001111,
+	['a'] = 0b0100010101010000,
+	['B'] = 0b0100101000111111,
+	['b'] = 0b0100000111010000,
+	['C'] = 0b0000000101010000,
+	['c'] = 0b0000000101010000,
+	['D'] = 0b0100100000111111,
+	['d'] = 0b0100100101010000,
+	['E'] = 0b0000000111110011,
+	['e'] = 0b1000000101110000,
+	['F'] = 0b0000000111000011,
+	['f'] = 0b0100101100000010,
+	['G'] = 0b0000001011111011,
+	['g'] = 0b0100100110010001,
+	['H'] = 0b0000001111001100,
+	['h'] = 0b0100000111000000,
+	['I'] = 0b0100100000110011,
+	['i'] = 0b0100000000000000,
+	['J'] = 0b0000000001111100,
+	['j'] = 0b0100100001010000,
+	['K'] = 0b0011000111000000,
+	['k'] = 0b0111100000000000,
+	['L'] = 0b0000000011110000,
+	['l'] = 0b0100100000000000,
+	['M'] = 0b0001010011001100,
+	['m'] = 0b0100001101001000,
+	['N'] = 0b0010010011001100,
+	['n'] = 0b0100000101000000,
+	['O'] = 0b0000000011111111,
+	['o'] = 0b0100000101010000,
+	['P'] = 0b0000001111000111,
+	['p'] = 0b0000100111000001,
+	['Q'] = 0b0010000011111111,
+	['q'] = 0b0100100110000001,
+	['R'] = 0b0010001111000111,
+	['r'] = 0b0000000101000000,
+	['S'] = 0b0000001110111011,
+	['s'] = 0b0100000110010001,
+	['T'] = 0b0100100000000011,
+	['t'] = 0b0100101100000000,
+	['U'] = 0b0000000011111100,
+	['u'] = 0b0100000001010000,
+	['V'] = 0b1001000011000000,
+	['v'] = 0b1000000001000000,
+	['W'] = 0b1010000011001100,
+	['w'] = 0b1010000001001000,
+	['X'] = 0b1011010000000000,
+	['x'] = 0b1011010000000000,
+	['Y'] = 0b0100001110000100,
+	['y'] = 0b0101010000000000,
+	['Z'] = 0b1001000000110011,
+	['z'] = 0b1000000100010000,
+	['0'] = 0b1001000011111111,
+	['1'] = 0b0001000000001100,
+	['2'] = 0b0000001101110111,
+	['3'] = 0b0000001000111111,
+	['4'] = 0b0000001110001100,
+	['5'] = 0b0000001110111011,
+	['6'] = 0b0000001111111001,
+	['7'] = 0b0000000000001111,
+	['8'] = 0b0000001111111111,
+	['9'] = 0b0000001110101111,
+	['='] = 0b0000001100110000,
+	['*'] = 0b1111111100000000,
+	['+'] = 0b0100101100000000,
+	['-'] = 0b0000001100000000,
+	['.'] = 0b10000000000000000,
+	['|'] = 0b0100100000000000,
+	['\\'] = 0b0010010000000000,
+	['/'] = 0b1001000000000000,
+	['_'] = 0b0000000000110000,
+	['?'] = 0b10100001000000111,
+	['!'] = 0b10000000000001100,
+	['('] = 0b0100100000100010,
+	['['] = 0b0100100000100010,
+	[')'] = 0b0100100000010001,
+	[']'] = 0b0100100000010001,
+	['<'] = 0b0011000000000000,
+	['>'] = 0b1000010000000000,
+	['{'] = 0b0100100100100010,
+	['}'] = 0b0100101000010001
+};
+
+/**
+ * Function mapping a character to an integer output for 7 segment display
+ * @param  c Character to map
+ * @return   Integer whose bits are representing individual segments of the display
+ */
+uint32_t segdisp_7seg_char2int(char c){
+	return segdisp_font_7seg[(uint8_t) c];
+}
 
-	return out;
-}
\ No newline at end of file
+/**
+ * Function mapping a character to an integer output for 16 segment display
+ * @param  c Character to map
+ * @return   Integer whose bits are representing individual segments of the display
+ */
+uint32_t segdisp_16seg_char2ing(char c){
+	return segdisp_font_16seg[(uint8_t) c];
+}
@@ -17,6 +17,7 @@
 
 #include "stdint.h"
 #include "ch.h"
+#include "hal.h"
 
 /** Configuration flag mask */
 #define SEGDISP_COMMON_ELECTRODE_FLAG 0b1
@@ -26,18 +27,114 @@
 #define SEGDISP_INVERTED_SEGMENT 1
 
 /** Configuration flag mask */
-#define SEGDISP_DRIVER_FLAG 0b01
+#define SEGDISP_DRIVER_FLAG 0b10
 /** Flag indicating that normal (non-inverted) output is used for the driving transistor*/
 #define SEGDISP_NONINVERTED_DRIVER 0b00
 /** Flag indicating that inverted output is used for the driving transistor*/
-#define SEGDISP_INVERTED_DRIVER 0b01
+#define SEGDISP_INVERTED_DRIVER 0b10
 
 /** Configuration flag mask */
-#define SEGDISP_SEGMENTS_FLAG 0b001
+#define SEGDISP_SEGMENTS_FLAG 0b100
 /** Flag indicating 7 segment display */
 #define SEGDISP_SEGMENTS_SEVEN 0b000
 /** Flag indicating 16 segment display */
-#define SEGDISP_SEGMENTS_SIXTEEN 0b001
+#define SEGDISP_SEGMENTS_SIXTEEN 0b100
+
+/** Configuration flag mask */
+#define SEGDISP_AXIS_FLAG 0b11000
+/** Flag indicating multiplexing by digits, one digit is lit in each phase */
+#define SEGDISP_AXIS_DIGITS 0b00000
+/** Flag indicating multiplexing by segments, one segment line is enabled in each phase and all digits having it lit */
+#define SEGDISP_AXIS_SEGMENTS 0b01000
+/** Flag indicating multiplexing by the axis with fewer phases (segments if there are fewer segments than digits) */
+#define SEGDISP_AXIS_AUTO 0b10000
+
+/** Configuration flag mask */
+#define SEGDISP_BLANK_FLAG 0b100000
+/** Flag indicating that every digit gets its phase, dark or not */
+#define SEGDISP_BLANK_SHOWN 0b000000
+/** Flag indicating that phases of dark digits are skipped and a dark display stops its refresh until the next update */
+#define SEGDISP_BLANK_SKIPPED 0b100000
+
+/** Numeric rendering flag aligning the number to the left (default is right) */
+#define SEGDISP_NUM_LEFT 0b01
+/** Numeric rendering flag padding the number by zeros to the width of the display */
+#define SEGDISP_NUM_ZEROS 0b10
+
+/** Maximum number of GPIO ports used by one display */
+#ifndef SEGDISP_MAX_PORTS
+#define SEGDISP_MAX_PORTS 4
+#endif
+
+/** Maximum number of digits of one display (width of the digit mask) */
+#define SEGDISP_MAX_DIGITS 32
+
+/** Maximum number of segments of one digit (width of the output value) */
+#define SEGDISP_MAX_SEGMENTS 32
+
+/** Size (in words) of the message buffer needed for text of given length */
+#define SEGDISP_MSG_WORDS(len, digits) ((len) > (digits) ? (len) : (digits))
+
+/** Size (in words) of the storage of the update mailbox */
+#define SEGDISP_MBOX_WORDS(digits) (3 * (digits))
+
+/** Size (in words) of the storage of the key scanning (segdisp_keys_init) */
+#define SEGDISP_KEYS_WORDS(digits) (3 * (digits))
+
+/** Key message flag set when the key was pressed, clear when it was released */
+#define SEGDISP_KEY_DOWN 0x10000
+/** Key message posted to the mailbox of the key scanning */
+#define SEGDISP_KEY_MSG(key, pressed) ((msg_t) ((key) | ((pressed) ? SEGDISP_KEY_DOWN : 0)))
+/** Index of the key of a key message */
+#define SEGDISP_KEY_INDEX(msg) ((int) ((msg) & 0xFFFF))
+
+/** Event flag of keys_event broadcast when a key was pressed */
+#define SEGDISP_KEYS_PRESSED 0b01
+/** Event flag of keys_event broadcast when a key was released */
+#define SEGDISP_KEYS_RELEASED 0b10
+
+/** Number of frames of the wipe animation (segdisp_anim_wipe) */
+#define SEGDISP_ANIM_WIPE_FRAMES(digits) (2 * (digits))
+
+/** Number of words of the dirty cell bitmap */
+#define SEGDISP_DIRTY_WORDS(digits) (((digits) + 31) / 32)
+
+/** Working area size of the refresh thread (segdisp_run) */
+#ifndef SEGDISP_REFRESH_WA_SIZE
+#define SEGDISP_REFRESH_WA_SIZE 128
+#endif
+
+/** Collection of the refresh statistics (segdisp_stats_get) */
+#ifndef SEGDISP_USE_STATS
+#define SEGDISP_USE_STATS FALSE
+#endif
+
+/** Number of binary code modulation planes (bits of the brightness level) */
+#ifndef SEGDISP_BCM_PLANES
+#define SEGDISP_BCM_PLANES 4
+#endif
+
+/** Maximum (full) brightness level */
+#define SEGDISP_BRIGHTNESS_MAX ((1 << SEGDISP_BCM_PLANES) - 1)
+
+/** Refresh is not running */
+#define SEGDISP_REFRESH_STOPPED 0
+/** Refresh is driven by a thread (segdisp_run) */
+#define SEGDISP_REFRESH_THREAD 1
+/** Refresh is driven by a virtual timer callback (segdisp_run_timer) */
+#define SEGDISP_REFRESH_TIMER 2
+/** Refresh is done by streaming precompiled port words (segdisp_run_dma) */
+#define SEGDISP_REFRESH_DMA 3
+/** Refresh is driven by a display manager (segdisp_mgr_run) */
+#define SEGDISP_REFRESH_MANAGED 4
+
+/**
+ * Port word setting the pins in mask to the levels in bits, in the STM32 BSRR format (set bits low, reset bits high)
+ */
+#define SEGDISP_PORT_WORD(mask, bits) ((uint32_t)((bits) & (mask)) | ((uint32_t)(~(bits) & (mask)) << 16))
+
+/** Size (in words) of the buffer with the compiled frame for segdisp_run_dma */
+#define SEGDISP_DMA_WORDS(ports, digits) ((ports) * (digits))
 
 
 /**
@@ -57,16 +154,206 @@ typedef struct segdisp_pins {
 	segdisp_pin_def_t pins[];
 } segdisp_pins_t;
 
+/**
+ * Output plan of one GPIO port. It's built by segdisp_init from the pin tables.
+ */
+typedef struct segdisp_port_plan {
+	/** Port */
+	ioportid_t port;
+	/** Mask of all pins of the port driven by the display */
+	ioportmask_t mask;
+	/** Levels of the pins with all digits disabled and all segments off */
+	ioportmask_t idle;
+	/** Levels written by the last phase, valid while out_valid of the display is set */
+	ioportmask_t last;
+} segdisp_port_plan_t;
+
+/**
+ * Position of one pin in the output plan
+ */
+typedef struct segdisp_pin_plan {
+	/** Index of the port in the plan */
+	uint8_t port;
+	/** Pin number within the port */
+	uint8_t pin;
+} segdisp_pin_plan_t;
+
+/**
+ * One step of the multiplex, the refresh walks the table of steps
+ */
+typedef struct segdisp_step {
+	/** Digit shown during the step (segment line when multiplexing by segments) */
+	uint16_t digit;
+	/** Nonzero if the digit is lit during the step, otherwise the display is dark */
+	uint8_t lit;
+	/** Brightness plane of the step */
+	uint8_t plane;
+	/** Duration of the step in system ticks */
+	systime_t ticks;
+} segdisp_step_t;
+
+struct segdisp;
+
+/**
+ * Output backend, drives the segment and digit lines of the display
+ */
+typedef struct segdisp_backend {
+	/**
+	 * Shows one multiplex phase
+	 * @param ctx        Backend context
+	 * @param disp       Display configuration structure
+	 * @param digit_mask Enabled digits (bit 0 is the digit 0), 0 turns all digits and segments off
+	 * @param segments   Output value of the segments as mapped by the font of the display
+	 */
+	void (*phase)(void *ctx, struct segdisp *disp, uint32_t digit_mask, uint32_t segments);
+	/**
+	 * Forgets the outputs cached by the backend, called by segdisp_out_invalidate, can be NULL
+	 * @param ctx Backend context
+	 */
+	void (*invalidate)(void *ctx);
+	/** Backend context */
+	void *ctx;
+	/** Bus shared by the outputs of the backend, e.g. the SPI driver, NULL if none.
+		The display manager never lights displays on the same bus in one phase. */
+	const void *bus;
+} segdisp_backend_t;
+
+/**
+ * Backend streaming compiled port words to the GPIO ports, e.g. by timer triggered circular DMA
+ */
+typedef struct segdisp_dma_backend {
+	/**
+	 * Starts circular streaming of one port
+	 * @param ctx    Backend context
+	 * @param index  Index of the stream (port index in the plan)
+	 * @param port   Port to write to
+	 * @param words  Port words (see SEGDISP_PORT_WORD), one per digit phase
+	 * @param count  Number of words
+	 * @param period Duration of one phase in microseconds
+	 * @return       Returns -1 on failure, 0 on success
+	 */
+	int (*start)(void *ctx, int index, ioportid_t port, const uint32_t *words, int count, int period);
+	/**
+	 * Stops all the streams
+	 * @param ctx Backend context
+	 */
+	void (*stop)(void *ctx);
+	/** Backend context */
+	void *ctx;
+} segdisp_dma_backend_t;
+
+/**
+ * Refresh statistics, times are in realtime counter ticks (see chSysGetRealtimeCounterX)
+ */
+typedef struct segdisp_stats {
+	/** Frames done */
+	uint32_t frames;
+	/** Steps done */
+	uint32_t steps;
+	/** Frames per second achieved in the last second */
+	uint32_t fps;
+	/** Shortest on-time of a lit digit */
+	rtcnt_t on_min;
+	/** Longest on-time of a lit digit */
+	rtcnt_t on_max;
+	/** Sum of the on-times of lit digits, divide by on_count for the average */
+	uint64_t on_sum;
+	/** Number of measured on-times */
+	uint32_t on_count;
+	/** Worst interval between the starts of two frames */
+	rtcnt_t frame_max;
+	/** Time spent showing the steps (inside segdisp_show_digit) */
+	uint64_t show_time;
+	/** Number of writer updates that blocked on display_buffer_mtx */
+	uint32_t lock_blocked;
+	/** Total time the writers were blocked on display_buffer_mtx */
+	uint64_t lock_wait;
+	/** Longest time a writer was blocked on display_buffer_mtx */
+	rtcnt_t lock_wait_max;
+	/** Number of text moves (scroll steps) done */
+	uint32_t scroll_steps;
+} segdisp_stats_t;
+
 /**
  * Structure used for configuring the scrolling
  */
 typedef struct segdisp_scroll_conf {
-	/** Delay between steps (in ms) */
+	/** Delay between steps (in ms), change it at runtime by segdisp_scroll_set */
 	int delay;
 	/** Number of characters shifted in one step */
 	int step;
 } segdisp_scroll_conf_t;
 
+/**
+ * One frame of an animation, see segdisp_anim_play
+ */
+typedef struct segdisp_anim_frame {
+	/** Output values of the digits, NULL to show the current content of the display */
+	const uint32_t *codes;
+	/** Digits turned off during the frame, bit 0 is the digit 0 */
+	uint32_t blank;
+	/** Brightness level of the frame, it scales the brightness of all the digits */
+	uint8_t level;
+	/** Duration of the frame in system ticks */
+	systime_t ticks;
+} segdisp_anim_frame_t;
+
+/**
+ * Keys wired between the digit lines and the return lines, see segdisp_keys_init
+ */
+typedef struct segdisp_keys_conf {
+	/** Return lines, all of them on one GPIO port */
+	segdisp_pins_t *returns;
+	/** Level of a return line when its key is pressed and its digit enabled, PAL_LOW or PAL_HIGH */
+	uint8_t active;
+	/** Number of frames a key has to keep its new state to be reported */
+	uint8_t debounce;
+	/** Mailbox receiving the SEGDISP_KEY_MSG messages, NULL if not used */
+	mailbox_t *mbox;
+} segdisp_keys_conf_t;
+
+/**
+ * Storage of the display for segdisp_init_static, declare it by SEGDISP_STORAGE
+ */
+typedef struct segdisp_storage {
+	/** Number of digits the storage is sized for */
+	int digits;
+	/** Front and back buffer followed by the dirty cell bitmap */
+	uint32_t *fb;
+	/** Output plan of the digit pins */
+	segdisp_pin_plan_t *dig_plan;
+	/** Table of the multiplex steps */
+	segdisp_step_t *steps;
+	/** Brightness levels of the digits */
+	uint8_t *brightness;
+	/** Display and string buffer mutex */
+	mutex_t *mutexes;
+	/** Working area of the refresh thread */
+	void *wa;
+	/** Size of the working area */
+	size_t wa_size;
+	/** Message buffer, NULL to allocate it from the heap */
+	uint32_t *msg;
+	/** Size of the message buffer in words */
+	int msg_size;
+} segdisp_storage_t;
+
+/**
+ * Declares static storage of a display with given number of digits for texts up to given length
+ */
+#define SEGDISP_STORAGE(name, digits, length)                                            \
+	static uint32_t name##_fb[2 * (digits) + SEGDISP_DIRTY_WORDS(digits)];               \
+	static segdisp_pin_plan_t name##_dig_plan[digits];                                   \
+	static segdisp_step_t name##_steps[(digits) * SEGDISP_BCM_PLANES];                   \
+	static uint8_t name##_brightness[digits];                                            \
+	static mutex_t name##_mutexes[2];                                                    \
+	static THD_WORKING_AREA(name##_wa, SEGDISP_REFRESH_WA_SIZE);                         \
+	static uint32_t name##_msg[SEGDISP_MSG_WORDS(length, digits)];                       \
+	static const segdisp_storage_t name = {                                              \
+		(digits), name##_fb, name##_dig_plan, name##_steps, name##_brightness,            \
+		name##_mutexes, name##_wa, sizeof(name##_wa), name##_msg, SEGDISP_MSG_WORDS(length, digits) \
+	}
+
 /**
  * Display configuration structure
  */
@@ -79,45 +366,273 @@ typedef struct segdisp {
 	segdisp_scroll_conf_t *scroll;
 	/** Pointer to the refreshing thread */
 	thread_t *thread; 
-	/** Pointer to the scrolling thread */
-	thread_t *scroll_thd;
-	/** Display buffer mutex (actual inside segdisp struct) */
+	/** Virtual timer of the scrolling */
+	virtual_timer_t scroll_timer;
+	/** Scrolling is running */
+	volatile bool scroll_running;
+	/** Number of scroll steps not applied yet */
+	volatile int scroll_due;
+	/** Number of characters the text is moved by the steps not applied yet */
+	volatile int scroll_shift;
+	/** A writer works on the text, scroll steps are not applied meanwhile */
+	volatile bool msg_active;
+	/** Display buffer mutex, serializes the writers of the back buffer */
 	mutex_t *display_buffer_mtx;
 	/** String buffer mutex (buffer inside segdisp struct) */
 	mutex_t *string_buffer_mtx;
-	/** Pointer to the buffer with currently displayed characters. Characters are already mapped to integer output */
+	/** Pointer to the buffer with currently displayed characters (front buffer). Characters are already mapped to integer output */
 	uint32_t *actual;
+	/** Pointer to the buffer the writers render to (back buffer) */
+	uint32_t *back;
+	/** Back buffer is published and will be swapped with the front one at the next frame boundary */
+	volatile bool swap_pending;
+	/** The writer withdrew a published frame, it has to be published again */
+	bool fb_withdrawn;
+	/** Back buffer holds the current content */
+	bool fb_synced;
+	/** Bitmap of the cells changed by the current update */
+	uint32_t *dirty;
+	/** Number of cells changed by the last update */
+	int touched;
+	/** Number of cells changed by all updates */
+	uint32_t touched_total;
+	/** Number of updates that changed nothing and were not published */
+	uint32_t updates_skipped;
+	/** A writer works on the back buffer, the mailbox is not applied meanwhile */
+	volatile bool writer_active;
+	/** Storage of the update mailbox, three slots of digits words (NULL if not used) */
+	uint32_t *mbox;
+	/** Slot filled by the producer */
+	uint8_t mbox_write;
+	/** Slot with the latest posted update */
+	uint8_t mbox_ready;
+	/** Slot applied to the display last */
+	uint8_t mbox_read;
+	/** The ready slot holds an update not applied yet */
+	volatile bool mbox_fresh;
+	/** Number of posted updates */
+	volatile uint32_t mbox_posts;
+	/** Number of applied updates, the other posts were coalesced */
+	uint32_t mbox_applied;
+	/** Frames of the playing animation, NULL if there's none */
+	const segdisp_anim_frame_t *anim;
+	/** Number of the animation frames */
+	int anim_number;
+	/** Number of plays of the animation, 0 to repeat it until stopped */
+	int anim_repeat;
+	/** Current animation frame, -1 until the animation starts at the next frame boundary */
+	int anim_frame;
+	/** Number of finished plays of the animation */
+	int anim_loops;
+	/** System time the current animation frame started at */
+	systime_t anim_start;
+	/** Output values shown by the refresh, the front buffer or the codes of the animation frame */
+	const uint32_t *shown;
+	/** Digits turned off by the animation frame */
+	uint32_t anim_blank;
+	/** Brightness level of the animation frame */
+	uint8_t anim_level;
+	/** Broadcast when a played animation finishes (not when it is stopped) */
+	event_source_t anim_event;
+	/** Key scanning configuration, NULL if the keys are not scanned */
+	const segdisp_keys_conf_t *keys;
+	/** Port of the return lines */
+	ioportid_t keys_port;
+	/** Keys are scanned by the running refresh */
+	bool keys_scan;
+	/** Digit enabled by the last step, its keys are read before the next digit, -1 if none */
+	int keys_digit;
+	/** Debounced state of the keys of each digit, bit j is the key on the return line j */
+	uint32_t *keys_state;
+	/** State of the keys of each digit waiting for the debounce */
+	uint32_t *keys_pending;
+	/** Number of frames the pending state of each digit was read */
+	uint32_t *keys_count;
+	/** Number of key messages dropped because the mailbox was full */
+	uint32_t keys_lost;
+	/** Broadcast with SEGDISP_KEYS_PRESSED and SEGDISP_KEYS_RELEASED flags when keys change their state */
+	event_source_t keys_event;
 
 	/** Refresh rate of the display in microseconds (default - 5000 us) */
 	int refresh;
-	/** Current offset of the text */
+	/** Current offset of the text, first displayed character */
 	int offset;
-	/** Currently displayed string */
-	char *buffer;
-	/** Lenght of the displayed string */
-	int buffer_strlen;
-	/** Configuration flags. For common anode and cathode configuration use SEGDISP_COMMON_ANODE and SEGDISP_COMMON_CATHODE respectively. 
-		To configure NPN and PNP driver, use SEGDISP_NPN_DRIVER and SEGDISP_PNP_DRIVER constants.
-		For 7 segment display use SEGDISP_SEGMENTS_SEVEN, for 16 segment display use SEGDISP_SEGMENTS_SIXTEEN
+	/** Displayed text encoded to output codes, padded by spaces to buffer_window */
+	uint32_t *buffer;
+	/** Capacity of the buffer in words */
+	int buffer_size;
+	/** Buffer was allocated from the heap by the display (not given by segdisp_set_msg_buffer) */
+	bool buffer_owned;
+	/** Length of the scrolled window, the text padded by spaces to at least the number of digits, 0 if there's no text */
+	int buffer_window;
+	/** Table of the multiplex steps of one frame, built when the refresh is started */
+	segdisp_step_t *steps;
+	/** Number of steps in one frame */
+	int steps_number;
+	/** Next step of the multiplex */
+	int step;
+	/** Brightness level of each digit */
+	uint8_t *brightness;
+	/** Brightness level of the whole display */
+	uint8_t brightness_global;
+	/** Gamma table with SEGDISP_BRIGHTNESS_MAX + 1 entries, NULL for linear brightness */
+	const uint8_t *gamma;
+	/** Binary code modulation is used, i.e. some digit is not at full brightness */
+	bool bcm;
+	/** Number of brightness planes used, less than SEGDISP_BCM_PLANES if refresh is too short for all of them */
+	uint8_t bcm_planes;
+	/** Brightness changed, the step table is rebuilt at the next frame boundary */
+	bool brightness_pending;
+#if SEGDISP_USE_STATS == TRUE
+	/** Refresh statistics */
+	segdisp_stats_t stats;
+	/** Sequence counter of the statistics, odd while the refresh updates them */
+	volatile uint32_t stats_seq;
+	/** Realtime counter at the last step */
+	rtcnt_t stats_last_step;
+	/** Realtime counter at the last frame start */
+	rtcnt_t stats_last_frame;
+	/** The last step was lit */
+	bool stats_last_lit;
+	/** System time at the start of the frame rate window */
+	systime_t stats_window;
+	/** Frames done in the frame rate window */
+	uint32_t stats_window_frames;
+	/** Writer updates blocked on display_buffer_mtx, written under it */
+	uint32_t stats_lock_blocked;
+	/** Total time the writers were blocked, written under display_buffer_mtx */
+	uint64_t stats_lock_wait;
+	/** Longest time a writer was blocked, written under display_buffer_mtx */
+	rtcnt_t stats_lock_wait_max;
+	/** Text moves by segdisp_move_cont, written under the string buffer mutex */
+	uint32_t stats_moves;
+	/** Scroll steps applied by the scroll timer or the refresh, written in the locked state */
+	uint32_t stats_scrolled;
+#endif
+	/** Digits with brightness level 0 */
+	uint32_t off_digits;
+	/** Lines (digits, segment lines when multiplexing by segments) skipped in the current frame as dark */
+	uint32_t dark;
+	/** Number of lines of one frame */
+	uint8_t lines;
+	/** Number of lines lit in the current frame, their steps share the time of the dark ones */
+	uint8_t lines_lit;
+	/** Step the current frame started with */
+	int step_first;
+	/** The whole display is dark, the refresh waits for the next update */
+	volatile bool idle;
+	/** Number of times the refresh stopped on a dark display */
+	uint32_t idle_count;
+	/** Refresh thread waiting on a dark display */
+	thread_reference_t idle_thread;
+	/** Virtual timer driving the refresh in SEGDISP_REFRESH_TIMER mode */
+	virtual_timer_t timer;
+	/** How the refresh is driven, one of the SEGDISP_REFRESH_ constants */
+	volatile uint8_t refresh_mode;
+	/** Mutex the display manager holds while it refreshes the display in SEGDISP_REFRESH_MANAGED mode */
+	mutex_t *mgr_mtx;
+	/** Backend streaming the port words in SEGDISP_REFRESH_DMA mode */
+	const segdisp_dma_backend_t *dma;
+	/** Compiled frame streamed in SEGDISP_REFRESH_DMA mode, words of port i start at i * digits->number */
+	uint32_t *dma_words;
+	/** Output backend (default segdisp_gpio_backend) */
+	const segdisp_backend_t *backend;
+	/** Working area of the refresh thread, NULL to allocate it from the heap */
+	void *wa;
+	/** Size of the working area */
+	size_t wa_size;
+	/** Configuration flags. For the polarity of the digit pins use SEGDISP_NONINVERTED_SEGMENT or SEGDISP_INVERTED_SEGMENT.
+		For the polarity of the segment pins use SEGDISP_NONINVERTED_DRIVER or SEGDISP_INVERTED_DRIVER.
+		For 7 segment display use SEGDISP_SEGMENTS_SEVEN, for 16 segment display use SEGDISP_SEGMENTS_SIXTEEN.
+		The multiplex axis is selected by SEGDISP_AXIS_DIGITS (default), SEGDISP_AXIS_SEGMENTS or SEGDISP_AXIS_AUTO.
+		Dark digits are skipped by the thread and timer refresh with SEGDISP_BLANK_SKIPPED.
 	*/
 	uint8_t flags;
+
+	/** Ports driven by the display, polarity is already resolved in the idle levels */
+	segdisp_port_plan_t ports[SEGDISP_MAX_PORTS];
+	/** Number of used entries in ports */
+	int ports_number;
+	/** The last levels of the ports are known, the phases write only the changed pins */
+	bool out_valid;
+	/** Number of port writes skipped because the phase didn't change the levels of the port */
+	uint32_t writes_avoided;
+	/** Plan entries of the segment pins */
+	segdisp_pin_plan_t seg_plan[SEGDISP_MAX_SEGMENTS];
+	/** Plan entries of the digit pins */
+	segdisp_pin_plan_t *dig_plan;
+	/** Mask of the output value bits that have a segment pin assigned */
+	uint32_t seg_mask;
+	/** Bits of the output value that are inverted in the font (segment is lit when the bit is clear) */
+	uint32_t seg_invert;
+	/** Multiplex axis, SEGDISP_AXIS_DIGITS or SEGDISP_AXIS_SEGMENTS */
+	uint8_t axis;
+	/** Digits having each segment lit, updated at the frame boundary when multiplexing by segments */
+	uint32_t axis_masks[SEGDISP_MAX_SEGMENTS];
+	/** Digits lit in each brightness plane when multiplexing by segments */
+	uint32_t plane_digits[SEGDISP_BCM_PLANES];
+	/** Character to output mapping table with 256 entries, indexed by (uint8_t) character */
+	const uint32_t *font;
+	/** Nonzero when the font already has the segment polarity applied (bits are pin levels) */
+	uint8_t font_polarized;
 } segdisp_t;
 
 
 void segdisp_seg_out(segdisp_t *disp, int seg, int out);
+void segdisp_out_invalidate(segdisp_t *disp);
 void segdisp_dig_ena(segdisp_t *disp, int digit, int out);
 void segdisp_show_digit(segdisp_t *disp, int position, int output);
+void segdisp_blank(segdisp_t *disp);
+int segdisp_refresh_start(segdisp_t *disp, uint8_t mode);
+systime_t segdisp_refresh_step(segdisp_t *disp);
 int segdisp_move_cont(segdisp_t *disp, int step);
 int segdisp_move_abs(segdisp_t *disp, int offset);
 
 int segdisp_init(segdisp_t *disp, segdisp_pins_t *segments, segdisp_pins_t *digits, uint8_t flags);
+int segdisp_init_static(segdisp_t *disp, segdisp_pins_t *segments, segdisp_pins_t *digits, uint8_t flags,
+	const segdisp_storage_t *storage);
 int segdisp_run(segdisp_t *disp, tprio_t priority);
+int segdisp_run_timer(segdisp_t *disp);
+int segdisp_run_dma(segdisp_t *disp, const segdisp_dma_backend_t *backend, uint32_t *words);
 void segdisp_stop(segdisp_t *disp); 
 int segdisp_set(segdisp_t *disp, int position, char output);
-int segdisp_set_str(segdisp_t *disp, char *text);
+int segdisp_set_str(segdisp_t *disp, const char *text);
+void segdisp_set_msg_buffer(segdisp_t *disp, uint32_t *buffer, int size);
+int segdisp_set_int(segdisp_t *disp, int32_t value, uint8_t flags);
+int segdisp_set_fixed(segdisp_t *disp, int32_t value, int decimals, uint8_t flags);
+int segdisp_set_hex(segdisp_t *disp, uint32_t value, uint8_t flags);
+int segdisp_mbox_init(segdisp_t *disp, uint32_t *storage);
+int segdisp_post_codes(segdisp_t *disp, const uint32_t *codes, int number);
+int segdisp_post_str(segdisp_t *disp, const char *text);
+int segdisp_post_int(segdisp_t *disp, int32_t value);
+void segdisp_mbox_apply(segdisp_t *disp);
+int segdisp_anim_play(segdisp_t *disp, const segdisp_anim_frame_t *frames, int number, int repeat);
+void segdisp_anim_stop(segdisp_t *disp);
+int segdisp_keys_init(segdisp_t *disp, const segdisp_keys_conf_t *conf, uint32_t *storage);
+int segdisp_key_pressed(segdisp_t *disp, int key);
+int segdisp_anim_blink(segdisp_anim_frame_t *frames, uint32_t mask, int on, int off);
+int segdisp_anim_fade(segdisp_anim_frame_t *frames, int steps, uint8_t from, uint8_t to, int duration);
+int segdisp_anim_text(segdisp_t *disp, segdisp_anim_frame_t *frame, uint32_t *codes, const char *text, int duration);
+int segdisp_anim_wipe(segdisp_t *disp, segdisp_anim_frame_t *frames, uint32_t *codes, const char *text, int duration);
+int segdisp_set_brightness(segdisp_t *disp, int position, uint8_t level);
+int segdisp_set_global_brightness(segdisp_t *disp, uint8_t level);
+void segdisp_set_gamma(segdisp_t *disp, const uint8_t *gamma);
+#if SEGDISP_USE_STATS == TRUE
+void segdisp_stats_get(segdisp_t *disp, segdisp_stats_t *stats);
+#endif
 int segdisp_scroll_run(segdisp_t *disp, tprio_t priority);
+int segdisp_scroll_set(segdisp_t *disp, int delay, int step);
 void segdisp_scroll_stop(segdisp_t *disp);
 
+int segdisp_set_backend(segdisp_t *disp, const segdisp_backend_t *backend);
+int segdisp_set_font(segdisp_t *disp, const uint32_t *font, uint8_t polarized);
+void segdisp_font_polarize(segdisp_t *disp, uint32_t *dst, const uint32_t *src);
+
+extern const segdisp_backend_t segdisp_gpio_backend;
+
+extern const uint32_t segdisp_font_7seg[256];
+extern const uint32_t segdisp_font_16seg[256];
+
 uint32_t segdisp_7seg_char2int(char c);
 uint32_t segdisp_16seg_char2ing(char c);
 
@@ -0,0 +1,122 @@
+/* segdisp_595.c -- Output backend for 74HC595 shift registers on SPI
+ *
+ * Copyright (C) 2016 Ondrej Novak
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+/**
+ * @file
+ * @brief Segdisp 74HC595 backend code
+ */
+
+
+#include "segdisp_595.h"
+#include "hal.h"
+#include "ch.h"
+
+#if HAL_USE_SPI == TRUE || defined(__DOXYGEN__)
+
+/**
+ * Sends one phase to the registers [internal]
+ * 
+ * Callable from the refresh thread and the timer callback, the transfer is only started.
+ * @param ctx        Shift register structure
+ * @param disp       Display configuration structure
+ * @param digit_mask Enabled digits, 0 for all outputs inactive
+ * @param segments   Output value of the segments
+ */
+static void segdisp_595_phase(void *ctx, segdisp_t *disp, uint32_t digit_mask, uint32_t segments){
+	segdisp_595_t *sr = (segdisp_595_t*)ctx;
+	uint64_t frame;
+	syssts_t sts;
+	int i;
+
+	if(digit_mask == 0){
+		segments = disp->seg_invert;
+	}
+	frame = (((uint64_t) digit_mask << sr->seg_bits) | (segments & disp->seg_mask)) ^ sr->invert;
+
+	sts = chSysGetStatusAndLockX();
+	if(sr->sent_valid && frame == sr->sent){
+		sr->skipped++;
+		chSysRestoreStatusX(sts);
+		return;
+	}
+	if(sr->spi->state == SPI_ACTIVE){
+		sr->overruns++;
+		chSysRestoreStatusX(sts);
+		return;
+	}
+	/* the first byte is shifted through to the last register of the chain */
+	for(i = 0; i < sr->bytes; i++){
+		sr->tx[i] = (uint8_t) (frame >> (8 * (sr->bytes - 1 - i)));
+	}
+	sr->sent = frame;
+	sr->sent_valid = true;
+	spiSelectI(sr->spi);
+	spiStartSendI(sr->spi, sr->bytes, sr->tx);
+	chSysRestoreStatusX(sts);
+}
+
+/**
+ * Forgets the last sent outputs, the next phase is sent even when it's the same [internal]
+ * @param ctx Shift register structure
+ */
+static void segdisp_595_invalidate(void *ctx){
+	segdisp_595_t *sr = (segdisp_595_t*)ctx;
+	syssts_t sts;
+
+	sts = chSysGetStatusAndLockX();
+	sr->sent_valid = false;
+	chSysRestoreStatusX(sts);
+}
+
+/**
+ * Initializes the shift register backend [external API]
+ * 
+ * Bind it to the display by segdisp_set_backend(disp, &sr->backend). The pins structures
+ * of the display then only give the numbers of segments and digits, their ports can be NULL.
+ * The segments have to fit to seg_bits outputs and the digits to the outputs that follow.
+ * @param  sr       Shift register structure
+ * @param  disp     Display the registers drive, initialized by segdisp_init
+ * @param  spi      SPI driver, started by the application
+ * @param  bytes    Number of cascaded registers
+ * @param  seg_bits Number of register outputs of the segments
+ * @param  invert   Outputs with inverted level
+ * @return          Returns -1 on failure, 0 on success
+ */
+int segdisp_595_init(segdisp_595_t *sr, segdisp_t *disp, SPIDriver *spi, int bytes, int seg_bits, uint64_t invert){
+	if(spi == NULL || bytes < 1 || bytes > SEGDISP_595_MAX_BYTES || seg_bits < 0 || seg_bits > 8 * bytes)
+		return -1;
+	/* wider display would shift its segments to the digit outputs and the digits out of the chain */
+	if(disp->segments->number > seg_bits || seg_bits + disp->digits->number > 8 * bytes)
+		return -1;
+
+	sr->spi = spi;
+	sr->bytes = bytes;
+	sr->seg_bits = seg_bits;
+	sr->invert = invert;
+	sr->overruns = 0;
+	sr->sent_valid = false;
+	sr->skipped = 0;
+	sr->backend.phase = segdisp_595_phase;
+	sr->backend.invalidate = segdisp_595_invalidate;
+	sr->backend.ctx = sr;
+	sr->backend.bus = spi;
+
+	return 0;
+}
+
+/**
+ * End of transfer callback of the SPI configuration, latches the shifted phase [external API]
+ * @param spip SPI driver
+ */
+void segdisp_595_end_cb(SPIDriver *spip){
+	chSysLockFromISR();
+	spiUnselectI(spip);
+	chSysUnlockFromISR();
+}
+
+#endif
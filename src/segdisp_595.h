@@ -0,0 +1,57 @@
+/* segdisp_595.h -- Output backend for 74HC595 shift registers on SPI
+ *
+ * Copyright (C) 2016 Ondrej Novak
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+/**
+ * @file
+ * @brief Segdisp 74HC595 backend header
+ */
+
+#ifndef SEGDISP_595_H
+#define SEGDISP_595_H
+
+#include "segdisp.h"
+
+#if HAL_USE_SPI == TRUE || defined(__DOXYGEN__)
+
+/** Maximum number of cascaded registers */
+#define SEGDISP_595_MAX_BYTES 8
+
+/**
+ * Cascaded 74HC595 registers driving the segments and digits. One phase is one SPI transfer
+ * of the whole chain, the latch (RCLK) is the slave select line of the SPI configuration.
+ * The structure has to be in memory accessible by the DMA.
+ */
+typedef struct segdisp_595 {
+	/** SPI driver, started with end_cb set to segdisp_595_end_cb */
+	SPIDriver *spi;
+	/** Number of cascaded registers (bytes of one transfer) */
+	uint8_t bytes;
+	/** Number of register outputs of the segments, outputs of the digits follow */
+	uint8_t seg_bits;
+	/** Outputs with inverted level (active low), the register outputs are numbered from the first register */
+	uint64_t invert;
+	/** Data of the running transfer */
+	uint8_t tx[SEGDISP_595_MAX_BYTES];
+	/** Number of phases dropped because the previous transfer was still running */
+	volatile uint32_t overruns;
+	/** Outputs of the last started transfer */
+	uint64_t sent;
+	/** sent holds the register outputs */
+	bool sent_valid;
+	/** Number of transfers skipped because the outputs didn't change */
+	uint32_t skipped;
+	/** Backend to bind by segdisp_set_backend */
+	segdisp_backend_t backend;
+} segdisp_595_t;
+
+int segdisp_595_init(segdisp_595_t *sr, segdisp_t *disp, SPIDriver *spi, int bytes, int seg_bits, uint64_t invert);
+void segdisp_595_end_cb(SPIDriver *spip);
+
+#endif
+
+#endif
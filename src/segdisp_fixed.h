@@ -0,0 +1,65 @@
+/* segdisp_fixed.h -- Output backend generated for fixed wiring
+ *
+ * Copyright (C) 2016 Ondrej Novak
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+/**
+ * @file
+ * @brief Segdisp backend with the wiring and polarity known at compile time
+ * 
+ * The wiring is given by three lists, each entry calls the macro given as the first argument:
+ * @code
+ * #define BOARD_PORTS(X, a, b, c)    X(GPIOD, a, b, c) X(GPIOE, a, b, c)
+ * #define BOARD_DIGITS(X, a, b)      X(0, GPIOD, 0, a, b) X(1, GPIOD, 1, a, b)
+ * #define BOARD_SEGMENTS(X, a, b)    X(0, GPIOE, 8, a, b) X(1, GPIOE, 9, a, b) ...
+ * SEGDISP_FIXED_BACKEND(board_backend, BOARD_PORTS, BOARD_SEGMENTS, BOARD_DIGITS,
+ *     SEGDISP_INVERTED_SEGMENT | SEGDISP_NONINVERTED_DRIVER);
+ * @endcode
+ * Segment and digit entries are (index, port, pin), the ports are written in the order of their list.
+ * The generated phase function computes each port word from constant masks with one write per port.
+ * Bind it by segdisp_set_backend(&disp, &board_backend), the display is used by the API as usual.
+ * The font must not be polarized.
+ */
+
+#ifndef SEGDISP_FIXED_H
+#define SEGDISP_FIXED_H
+
+#include "segdisp.h"
+
+/** Pin mask of a list entry on the port [internal] */
+#define SEGDISP_FIXED_MASK(i, port, pin, P, word) \
+	| ((port) == (P) ? PAL_PORT_BIT(pin) : 0)
+
+/** Pin level of a list entry on the port, bit i of the word [internal] */
+#define SEGDISP_FIXED_BIT(i, port, pin, P, word) \
+	| ((port) == (P) ? (ioportmask_t) (((word) >> (i)) & 1U) << (pin) : 0)
+
+/** Idle levels of the port [internal] */
+#define SEGDISP_FIXED_IDLE(P, segs, digs, flags)                                                     \
+	(((flags) & SEGDISP_DRIVER_FLAG) == SEGDISP_INVERTED_DRIVER ? (0 segs(SEGDISP_FIXED_MASK, P, 0)) : 0) | \
+	(((flags) & SEGDISP_COMMON_ELECTRODE_FLAG) != SEGDISP_INVERTED_SEGMENT ? (0 digs(SEGDISP_FIXED_MASK, P, 0)) : 0)
+
+/** Writes one port of the phase [internal] */
+#define SEGDISP_FIXED_WRITE(P, segs, digs, flags)                                                    \
+	palWriteGroup((P), (0 segs(SEGDISP_FIXED_MASK, P, 0) digs(SEGDISP_FIXED_MASK, P, 0)), 0,          \
+		(SEGDISP_FIXED_IDLE(P, segs, digs, flags)) ^                                                  \
+		(0 segs(SEGDISP_FIXED_BIT, P, segments) digs(SEGDISP_FIXED_BIT, P, digit_mask)));
+
+/**
+ * Defines backend of the given name for the wiring and flags (see segdisp_init)
+ */
+#define SEGDISP_FIXED_BACKEND(name, ports, segs, digs, flags)                                        \
+	static void name##_phase(void *ctx, segdisp_t *disp, uint32_t digit_mask, uint32_t segments){    \
+		(void) ctx;                                                                                   \
+		(void) disp;                                                                                  \
+		if(digit_mask == 0){                                                                          \
+			segments = 0;                                                                             \
+		}                                                                                             \
+		ports(SEGDISP_FIXED_WRITE, segs, digs, flags)                                                 \
+	}                                                                                                 \
+	static const segdisp_backend_t name = {name##_phase, NULL, NULL, NULL}
+
+#endif
@@ -0,0 +1,296 @@
+/* segdisp_mgr.c -- Refresh of multiple displays by one thread
+ *
+ * Copyright (C) 2016 Ondrej Novak
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+/**
+ * @file
+ * @brief Segdisp display manager code
+ */
+
+
+#include "segdisp_mgr.h"
+#include "hal.h"
+#include "ch.h"
+#include "chthreads.h"
+
+/**
+ * Adds the time spent refreshing to the load statistics [internal]
+ * @param mgr  Display manager structure
+ * @param busy Realtime counter ticks spent in the last phase
+ */
+static void segdisp_mgr_account(segdisp_mgr_t *mgr, rtcnt_t busy){
+	rtcnt_t now = chSysGetRealtimeCounterX();
+	rtcnt_t total;
+
+	mgr->busy += busy;
+	if(++mgr->window_phases < SEGDISP_MGR_LOAD_PHASES)
+		return;
+
+	total = now - mgr->window_start;
+	if(total != 0){
+		mgr->load = (int) (((uint64_t) mgr->busy * 1000) / total);
+	}
+	mgr->busy = 0;
+	mgr->window_phases = 0;
+	mgr->window_start = now;
+}
+
+/**
+ * Checks whether a display of the group uses the backend bus [internal]
+ * @param  mgr Display manager structure
+ * @param  g   Group
+ * @param  bus Backend bus, NULL for none
+ * @return     Returns nonzero if the group uses the bus
+ */
+static int segdisp_mgr_bus_used(segdisp_mgr_t *mgr, int g, const void *bus){
+	int i;
+
+	if(bus == NULL)
+		return 0;
+
+	for(i = 0; i < mgr->number; i++){
+		if(mgr->group[i] == g && mgr->displays[i]->refresh_mode == SEGDISP_REFRESH_MANAGED &&
+			mgr->displays[i]->backend->bus == bus)
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Steps the displays of one group through one digit slot of the phase [internal]
+ * 
+ * Every display keeps its own step deadlines within the phase, so brightness planes of different
+ * weights take their own durations. A display that finishes its slot early is blanked until the phase ends.
+ * The displays are touched only with the mutex of the manager held, so segdisp_stop can't come in between.
+ * @param mgr Display manager structure
+ * @param g   Group
+ */
+static void segdisp_mgr_phase(segdisp_mgr_t *mgr, int g){
+	systime_t due[SEGDISP_MGR_MAX_DISPLAYS];
+	systime_t end = US2ST(mgr->refresh);
+	systime_t t = 0;
+	systime_t next;
+	rtcnt_t start = chSysGetRealtimeCounterX();
+	rtcnt_t busy = 0;
+	segdisp_t *disp;
+	int i;
+
+	chMtxLock(&mgr->mtx);
+	/* the previous group is blanked first, it may share pins with this one */
+	for(i = 0; i < mgr->number; i++){
+		disp = mgr->displays[i];
+		due[i] = 0;
+		if(disp->refresh_mode != SEGDISP_REFRESH_MANAGED || mgr->groups == 1)
+			continue;
+		/* displays sharing pins overwrite the output levels of each other */
+		segdisp_out_invalidate(disp);
+		/* a blank transfer would still be running when this group's phase goes to the same bus,
+		 * and that phase overwrites the outputs anyway */
+		if(mgr->group[i] == (g + mgr->groups - 1) % mgr->groups && !segdisp_mgr_bus_used(mgr, g, disp->backend->bus)){
+			segdisp_blank(disp);
+		}
+	}
+
+	for(i = 0; i < mgr->number; i++){
+		disp = mgr->displays[i];
+		if(disp->refresh_mode == SEGDISP_REFRESH_MANAGED && mgr->group[i] == g){
+			due[i] = segdisp_refresh_step(disp);
+		}
+	}
+
+	while(true){
+		next = end;
+		for(i = 0; i < mgr->number; i++){
+			if(due[i] != 0 && due[i] < next)
+				next = due[i];
+		}
+		busy += chSysGetRealtimeCounterX() - start;
+		chMtxUnlock(&mgr->mtx);
+		chThdSleep(next - t);
+		chMtxLock(&mgr->mtx);
+		start = chSysGetRealtimeCounterX();
+		t = next;
+		if(t == end)
+			break;
+
+		for(i = 0; i < mgr->number; i++){
+			if(due[i] != t)
+				continue;
+			disp = mgr->displays[i];
+			if(disp->refresh_mode == SEGDISP_REFRESH_MANAGED && disp->steps[disp->step].plane != 0){
+				due[i] = t + segdisp_refresh_step(disp);
+			}
+			else{
+				/* slot of the digit is over before the phase */
+				if(disp->refresh_mode == SEGDISP_REFRESH_MANAGED){
+					segdisp_blank(disp);
+				}
+				due[i] = 0;
+			}
+		}
+	}
+	chMtxUnlock(&mgr->mtx);
+
+	segdisp_mgr_account(mgr, busy);
+}
+
+/* This thread refreshes all the displays of the manager, one group per phase */
+static THD_FUNCTION(segdisp_mgr_thread, arg) {
+  segdisp_mgr_t *mgr = (segdisp_mgr_t*)arg;
+  chRegSetThreadName("segdisp_mgr");
+
+  mgr->window_start = chSysGetRealtimeCounterX();
+  while (true) {
+  	int g;
+  	for(g = 0; g < mgr->groups; g++){
+  		segdisp_mgr_phase(mgr, g);
+  	}
+
+  	if(chThdShouldTerminateX()){
+  		chThdExit((msg_t) 0);
+  	}
+  }
+}
+
+/**
+ * Checks whether two displays share any pin or backend bus [internal]
+ * @param  a Display configuration structure
+ * @param  b Display configuration structure
+ * @return   Returns nonzero if the displays drive the same pin or bus
+ */
+static int segdisp_mgr_conflict(segdisp_t *a, segdisp_t *b){
+	int i;
+	int j;
+
+	/* e.g. two shift register chains on one SPI, the second transfer of a phase would be refused */
+	if(a->backend->bus != NULL && a->backend->bus == b->backend->bus)
+		return 1;
+
+	for(i = 0; i < a->ports_number; i++){
+		for(j = 0; j < b->ports_number; j++){
+			if(a->ports[i].port == b->ports[j].port && (a->ports[i].mask & b->ports[j].mask) != 0)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Initializes the display manager structure [external API]
+ * @param mgr Display manager structure
+ */
+void segdisp_mgr_init(segdisp_mgr_t *mgr){
+	mgr->number = 0;
+	mgr->groups = 0;
+	mgr->thread = NULL;
+	mgr->refresh = 5000;
+	mgr->busy = 0;
+	mgr->window_phases = 0;
+	mgr->load = 0;
+	chMtxObjectInit(&mgr->mtx);
+}
+
+/**
+ * Registers an initialized display to the manager [external API]
+ * 
+ * The display is put to the first group of displays it shares no pin or backend bus with,
+ * so displays on disjoint pins are lit in the same phase.
+ * @param  mgr  Display manager structure
+ * @param  disp Display configuration structure, its refresh must not be running
+ * @return      Returns -1 on failure, 0 on success
+ */
+int segdisp_mgr_add(segdisp_mgr_t *mgr, segdisp_t *disp){
+	int g;
+	int i;
+
+	if(mgr->thread != NULL || mgr->number == SEGDISP_MGR_MAX_DISPLAYS)
+		return -1;
+	if(disp->thread != NULL || disp->refresh_mode != SEGDISP_REFRESH_STOPPED)
+		return -1;
+
+	for(g = 0; g < mgr->groups; g++){
+		for(i = 0; i < mgr->number; i++){
+			if(mgr->group[i] == g && segdisp_mgr_conflict(mgr->displays[i], disp))
+				break;
+		}
+		if(i == mgr->number)
+			break;
+	}
+
+	if(g == mgr->groups){
+		mgr->groups++;
+	}
+	mgr->group[mgr->number] = g;
+	mgr->displays[mgr->number] = disp;
+	mgr->number++;
+
+	return 0;
+}
+
+/**
+ * Run the refresh of all registered displays [external API]
+ * 
+ * Refresh of every display is set to the refresh of the manager, so all of them share one timebase.
+ * @param  mgr      Display manager structure
+ * @param  priority Priority of the refreshing thread
+ * @return          Returns -1 on failure, 0 on success
+ */
+int segdisp_mgr_run(segdisp_mgr_t *mgr, tprio_t priority){
+	int i;
+
+	if(mgr->thread != NULL || mgr->number == 0)
+		return -1;
+
+	for(i = 0; i < mgr->number; i++){
+		mgr->displays[i]->refresh = mgr->refresh;
+		mgr->displays[i]->mgr_mtx = &mgr->mtx;
+		if(segdisp_refresh_start(mgr->displays[i], SEGDISP_REFRESH_MANAGED) != 0){
+			while(i-- > 0){
+				segdisp_stop(mgr->displays[i]);
+			}
+			return -1;
+		}
+	}
+
+	mgr->thread = chThdCreateFromHeap(NULL, THD_WORKING_AREA_SIZE(256), priority, segdisp_mgr_thread, mgr);
+	if(mgr->thread == NULL){
+		for(i = 0; i < mgr->number; i++){
+			segdisp_stop(mgr->displays[i]);
+		}
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Stop the refresh of all registered displays [external API]
+ * @param mgr Display manager structure
+ */
+void segdisp_mgr_stop(segdisp_mgr_t *mgr){
+	int i;
+
+	if(mgr->thread == NULL)
+		return;
+
+	chThdTerminate(mgr->thread);
+	chThdWait(mgr->thread);
+	mgr->thread = NULL;
+
+	for(i = 0; i < mgr->number; i++){
+		segdisp_stop(mgr->displays[i]);
+	}
+}
+
+/**
+ * Get the CPU load of the manager thread [external API]
+ * @param  mgr Display manager structure
+ * @return     Load in per mille, averaged over SEGDISP_MGR_LOAD_PHASES phases
+ */
+int segdisp_mgr_load(segdisp_mgr_t *mgr){
+	return mgr->load;
+}
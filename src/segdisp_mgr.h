@@ -0,0 +1,62 @@
+/* segdisp_mgr.h -- Refresh of multiple displays by one thread
+ *
+ * Copyright (C) 2016 Ondrej Novak
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+/**
+ * @file
+ * @brief Segdisp display manager header
+ */
+
+#ifndef SEGDISP_MGR_H
+#define SEGDISP_MGR_H
+
+#include "segdisp.h"
+
+/** Maximum number of displays driven by one manager */
+#ifndef SEGDISP_MGR_MAX_DISPLAYS
+#define SEGDISP_MGR_MAX_DISPLAYS 8
+#endif
+
+/** Number of phases the CPU load is averaged over */
+#define SEGDISP_MGR_LOAD_PHASES 64
+
+/**
+ * Display manager structure. All registered displays are refreshed by one thread,
+ * displays on disjoint pins are put to one group and lit in the same phase.
+ */
+typedef struct segdisp_mgr {
+	/** Registered displays */
+	segdisp_t *displays[SEGDISP_MGR_MAX_DISPLAYS];
+	/** Group of each display */
+	uint8_t group[SEGDISP_MGR_MAX_DISPLAYS];
+	/** Number of registered displays */
+	int number;
+	/** Number of groups (phases between two steps of one display) */
+	int groups;
+	/** Pointer to the refreshing thread */
+	thread_t *thread;
+	/** Duration of one phase in microseconds (default - 5000 us) */
+	int refresh;
+	/** Realtime counter ticks spent refreshing in the current load window */
+	rtcnt_t busy;
+	/** Realtime counter value at the start of the current load window */
+	rtcnt_t window_start;
+	/** Phases done in the current load window */
+	int window_phases;
+	/** CPU load of the manager thread in per mille, averaged over SEGDISP_MGR_LOAD_PHASES phases */
+	volatile int load;
+	/** Held by the manager thread while it works on the displays, segdisp_stop waits for it */
+	mutex_t mtx;
+} segdisp_mgr_t;
+
+void segdisp_mgr_init(segdisp_mgr_t *mgr);
+int segdisp_mgr_add(segdisp_mgr_t *mgr, segdisp_t *disp);
+int segdisp_mgr_run(segdisp_mgr_t *mgr, tprio_t priority);
+void segdisp_mgr_stop(segdisp_mgr_t *mgr);
+int segdisp_mgr_load(segdisp_mgr_t *mgr);
+
+#endif
@@ -7,38 +7,17 @@
  */
 
 #include "util.h"
-#include "string.h"
 
-void utils_str_shift(char *str, int step){
-	int len = strlen(str);
-	int steps;
-	int i;
-	char tmp;
-
-	if(len < 2)
-		return;
-	if(len == 2){
-		tmp = str[0];
-		str[0] = str[1];
-		str[1] = tmp;
-	}
+/**
+ * Modulo with non-negative result
+ * @param  value   Dividend
+ * @param  modulus Positive divisor
+ * @return         value mod modulus in range 0 to modulus - 1
+ */
+int utils_mod(int value, int modulus){
+	int r = value % modulus;
 
-	if(step < 0){
-		for(steps = 0; steps < -step; steps++){
-			tmp = str[len - 1];
-			for(i = len - 1; i > 0; i--){
-				str[i] = str[i-1]; 
-			}
-			str[0] = tmp;
-		}
-	}
-	else if(step > 0){
-		for(steps = 0; steps < step; steps++){
-			tmp = str[0];
-			for(i = 0; i < len; i++){
-				str[i] = str[i+1]; 
-			}
-			str[len - 1] = tmp;
-		}
-	}
-}
\ No newline at end of file
+	if(r < 0)
+		r += modulus;
+	return r;
+}
@@ -9,6 +9,6 @@
 #ifndef UTIL_H
 #define UTIL_H
 
-void utils_str_shift(char *str, int step);
+int utils_mod(int value, int modulus);
 
 #endif
\ No newline at end of file